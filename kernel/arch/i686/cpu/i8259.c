@@ -124,7 +124,13 @@ void i8259_Disable() { i8259_SetMask(0xFFFF); }
 
 void i8259_Mask(int irq) { i8259_SetMask(g_PicMask | (1 << irq)); }
 
-void i8259_Unmask(int irq) { i8259_SetMask(g_PicMask & ~(1 << irq)); }
+void i8259_Unmask(int irq)
+{
+   // Lines on the slave PIC also need the cascade input (IRQ2) open
+   uint16_t mask = g_PicMask & ~(1 << irq);
+   if (irq >= 8) mask &= ~(1 << 2);
+   i8259_SetMask(mask);
+}
 
 uint16_t i8259_ReadIrqRequestRegister()
 {
@@ -12,10 +12,21 @@ uint8_t __attribute__((cdecl)) i686_inb(uint16_t port);
 uint16_t __attribute__((cdecl)) i686_inw(uint16_t port);
 uint32_t __attribute__((cdecl)) i686_inl(uint16_t port);
 
+/* String I/O: transfer count 16-bit words between port and buffer */
+void __attribute__((cdecl)) i686_insw(uint16_t port, void *buffer,
+                                      uint32_t count);
+void __attribute__((cdecl)) i686_outsw(uint16_t port, const void *buffer,
+                                       uint32_t count);
+
 uint8_t __attribute__((cdecl)) i686_EnableInterrupts();
 uint8_t __attribute__((cdecl)) i686_DisableInterrupts();
 
+/* Critical sections that nest: save EFLAGS and disable, then restore IF */
+uint32_t __attribute__((cdecl)) i686_SaveInterrupts();
+void __attribute__((cdecl)) i686_RestoreInterrupts(uint32_t flags);
+
 void i686_iowait();
+void __attribute__((cdecl)) i686_WaitForInterrupt();
 void __attribute__((cdecl)) i686_Panic();
 
 void __attribute__((cdecl)) i686_Halt();
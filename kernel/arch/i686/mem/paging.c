@@ -3,28 +3,38 @@
 #include "paging.h"
 #include <mem/memdefs.h>
 #include <mem/memory.h>
+#include <mem/pmm.h>
+#include <mem/vmm.h>
 #include <std/stdio.h>
 #include <std/string.h>
+#include <sys/sys.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-extern uint8_t __end; // provided by linker, end of kernel image
-
 #define PAGE_TABLE_ENTRIES 1024
 #define PAGE_DIR_ENTRIES 1024
 
-// Identity-map a low window so existing kernel code keeps working.
-#define IDENTITY_MAP_LIMIT (64 * 1024 * 1024u) // 64 MiB
+/* CPUID leaf 1 EDX feature bits */
+#define CPUID_FEAT_PSE (1u << 3)
+#define CPUID_FEAT_PGE (1u << 13)
+
+/* CR4 control bits */
+#define CR4_PSE (1u << 4)
+#define CR4_PGE (1u << 7)
+
+#define LARGE_PAGE_SIZE 0x400000u // 4 MiB
+
+// One kernel page, right above the identity window, for temporarily mapping
+// frames the kernel cannot reach through the identity map. Its page table is
+// created in the kernel directory at boot, so every directory shares it.
+#define SCRATCH_VADDR IDENTITY_MAP_LIMIT
 
 static uint32_t *kernel_page_directory = NULL;
 static uint32_t *current_page_directory = NULL;
-static uintptr_t phys_alloc_ptr = 0;
-
-static inline uintptr_t align_up(uintptr_t v, size_t a)
-{
-   return (v + (a - 1)) & ~(uintptr_t)(a - 1);
-}
+static bool use_large_pages = false;
+static uint32_t global_flag = 0; // PAGE_GLOBAL when CR4.PGE is on
+static uint32_t *scratch_pte = NULL;
 
 static inline void load_cr3(uint32_t phys_addr)
 {
@@ -36,9 +46,22 @@ static inline void enable_paging_hw(void)
    uint32_t cr0;
    __asm__ __volatile__("mov %%cr0, %0" : "=r"(cr0));
    cr0 |= 0x80000000u; // set PG bit
+   cr0 |= 0x00010000u; // set WP so kernel writes honour copy-on-write
    __asm__ __volatile__("mov %0, %%cr0" ::"r"(cr0) : "memory");
 }
 
+static inline uint32_t read_cr4(void)
+{
+   uint32_t val;
+   __asm__ __volatile__("mov %%cr4, %0" : "=r"(val));
+   return val;
+}
+
+static inline void write_cr4(uint32_t val)
+{
+   __asm__ __volatile__("mov %0, %%cr4" ::"r"(val) : "memory");
+}
+
 static inline void invlpg(uint32_t addr)
 {
    __asm__ __volatile__("invlpg (%0)" ::"r"(addr) : "memory");
@@ -51,22 +74,14 @@ static inline uint32_t read_cr3(void)
    return val;
 }
 
-// Very small physical page allocator backed by the kernel's BSS end.
-// This is sufficient for testing and bootstrap; replace with a real PMM later.
-static uint32_t alloc_frame(void)
-{
-   if (!phys_alloc_ptr)
-   {
-      phys_alloc_ptr = align_up((uintptr_t)&__end, PAGE_SIZE);
-   }
-   uint32_t frame = (uint32_t)phys_alloc_ptr;
-   phys_alloc_ptr += PAGE_SIZE;
-   return frame;
-}
+// Paging structures are accessed through the identity map, so their frames
+// must come from the PMM's low zone.
+static uint32_t alloc_frame(void) { return PMM_AllocateLowPage(); }
 
 static uint32_t *alloc_page_table(void)
 {
    uint32_t phys = alloc_frame();
+   if (!phys) return NULL;
    uint32_t *tbl = (uint32_t *)phys; // identity mapped
    memset(tbl, 0, PAGE_SIZE);
    return tbl;
@@ -75,6 +90,7 @@ static uint32_t *alloc_page_table(void)
 static uint32_t *alloc_page_directory(void)
 {
    uint32_t phys = alloc_frame();
+   if (!phys) return NULL;
    uint32_t *pd = (uint32_t *)phys; // identity mapped
    memset(pd, 0, PAGE_SIZE);
    return pd;
@@ -82,6 +98,18 @@ static uint32_t *alloc_page_directory(void)
 
 static void identity_map_range(uint32_t *pd, uint32_t start, uint32_t end)
 {
+   // The identity window is the same in every directory, so its entries are
+   // marked global and survive CR3 reloads on process switches.
+   if (use_large_pages)
+   {
+      for (uint32_t addr = start; addr < end; addr += LARGE_PAGE_SIZE)
+      {
+         pd[addr >> 22] = (addr & 0xFFC00000u) | PAGE_PRESENT | PAGE_RW |
+                          PAGE_LARGE | global_flag;
+      }
+      return;
+   }
+
    for (uint32_t addr = start; addr < end; addr += PAGE_SIZE)
    {
       uint32_t pd_idx = addr >> 22;           // top 10 bits
@@ -90,24 +118,55 @@ static void identity_map_range(uint32_t *pd, uint32_t start, uint32_t end)
       if (!(pd[pd_idx] & PAGE_PRESENT))
       {
          uint32_t *pt = alloc_page_table();
+         if (!pt)
+         {
+            printf("[paging] identity map: out of page tables at 0x%08x\n",
+                   addr);
+            return;
+         }
          pd[pd_idx] = ((uint32_t)pt) | PAGE_PRESENT | PAGE_RW;
       }
 
       uint32_t *pt = (uint32_t *)(pd[pd_idx] & 0xFFFFF000u);
-      pt[pt_idx] = (addr & 0xFFFFF000u) | PAGE_PRESENT | PAGE_RW;
+      pt[pt_idx] = (addr & 0xFFFFF000u) | PAGE_PRESENT | PAGE_RW | global_flag;
    }
 }
 
 void i686_Paging_Initialize(void)
 {
+   // 4 MiB pages and global kernel mappings when the CPU supports them
+   uint32_t features = get_cpu_features();
+   uint32_t cr4 = read_cr4();
+   if (features & CPUID_FEAT_PSE)
+   {
+      cr4 |= CR4_PSE;
+      use_large_pages = true;
+   }
+   if (features & CPUID_FEAT_PGE) global_flag = PAGE_GLOBAL;
+   write_cr4(cr4);
+
    // Bootstrap identity-mapped kernel directory
    kernel_page_directory = alloc_page_directory();
    identity_map_range(kernel_page_directory, 0, IDENTITY_MAP_LIMIT);
 
+   uint32_t *scratch_pt = alloc_page_table();
+   if (scratch_pt)
+   {
+      kernel_page_directory[SCRATCH_VADDR >> 22] =
+          (uint32_t)scratch_pt | PAGE_PRESENT | PAGE_RW;
+      scratch_pte = &scratch_pt[(SCRATCH_VADDR >> 12) & 0x3FF];
+   }
+
    // Set current directory and enable
    current_page_directory = kernel_page_directory;
    load_cr3((uint32_t)kernel_page_directory);
    i686_Paging_Enable();
+
+   // Global pages are enabled only once paging is on
+   if (global_flag) write_cr4(read_cr4() | CR4_PGE);
+
+   printf("[paging] identity map: %s pages%s\n",
+          use_large_pages ? "4 MiB" : "4 KiB", global_flag ? ", global" : "");
 }
 
 void i686_Paging_Enable(void) { enable_paging_hw(); }
@@ -115,6 +174,7 @@ void i686_Paging_Enable(void) { enable_paging_hw(); }
 void *i686_Paging_CreatePageDirectory(void)
 {
    uint32_t *pd = alloc_page_directory();
+   if (!pd) return NULL;
    // Copy kernel mappings so shared kernel space stays accessible
    for (size_t i = 0; i < PAGE_DIR_ENTRIES; ++i)
    {
@@ -123,10 +183,61 @@ void *i686_Paging_CreatePageDirectory(void)
    return pd;
 }
 
+// True if pd[pd_idx] points at a page table owned by pd rather than one
+// shared with the kernel directory (4 MiB entries are always shared).
+static bool is_private_table(uint32_t *pd, size_t pd_idx)
+{
+   uint32_t pde = pd[pd_idx];
+   if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) return false;
+   if (pd == kernel_page_directory) return true;
+   return (pde & 0xFFFFF000u) !=
+          (kernel_page_directory[pd_idx] & 0xFFFFF000u);
+}
+
 void i686_Paging_DestroyPageDirectory(void *page_dir)
 {
-   // No-op for now; simple allocator cannot free.
-   (void)page_dir;
+   uint32_t *pd = (uint32_t *)page_dir;
+   if (!pd || pd == kernel_page_directory) return;
+
+   if (pd == current_page_directory)
+      i686_Paging_SwitchPageDirectory(kernel_page_directory);
+
+   // Tables copied from the kernel directory are shared; only the ones this
+   // directory created belong to it. Their user frames go back to the PMM
+   // along with the tables themselves.
+   for (size_t i = 0; i < PAGE_DIR_ENTRIES; ++i)
+   {
+      uint32_t pde = pd[i];
+      if (!is_private_table(pd, i)) continue;
+
+      uint32_t *pt = (uint32_t *)(pde & 0xFFFFF000u);
+      for (size_t j = 0; j < PAGE_TABLE_ENTRIES; ++j)
+      {
+         uint32_t pte = pt[j];
+         if ((pte & PAGE_PRESENT) && (pte & PAGE_USER))
+            PMM_FreePhysicalPage(pte & 0xFFFFF000u);
+      }
+      PMM_FreePhysicalPage((uint32_t)pt);
+   }
+
+   PMM_FreePhysicalPage((uint32_t)pd);
+}
+
+// Replace a 4 MiB mapping with an equivalent page table so single pages in
+// its range can be remapped.
+static uint32_t *split_large_page(uint32_t *pd, uint32_t pd_idx)
+{
+   uint32_t pde = pd[pd_idx];
+   uint32_t *pt = alloc_page_table();
+   if (!pt) return NULL;
+
+   uint32_t base = pde & 0xFFC00000u;
+   uint32_t flags = pde & (PAGE_RW | PAGE_USER | PAGE_GLOBAL);
+   for (uint32_t i = 0; i < PAGE_TABLE_ENTRIES; ++i)
+      pt[i] = (base + i * PAGE_SIZE) | flags | PAGE_PRESENT;
+
+   pd[pd_idx] = ((uint32_t)pt) | (pde & (PAGE_RW | PAGE_USER)) | PAGE_PRESENT;
+   return pt;
 }
 
 static uint32_t *get_page_table(uint32_t *pd, uint32_t vaddr, bool create)
@@ -137,12 +248,27 @@ static uint32_t *get_page_table(uint32_t *pd, uint32_t vaddr, bool create)
    {
       if (!create) return NULL;
       uint32_t *pt = alloc_page_table();
+      if (!pt) return NULL;
       pd[pd_idx] = ((uint32_t)pt) | PAGE_PRESENT | PAGE_RW;
       return pt;
    }
+   if (pde & PAGE_LARGE) return split_large_page(pd, pd_idx);
    return (uint32_t *)(pde & 0xFFFFF000u);
 }
 
+// Give pd its own copy of a page table it shares with the kernel directory,
+// so user mappings never leak into other address spaces.
+static uint32_t *unshare_page_table(uint32_t *pd, uint32_t pd_idx)
+{
+   uint32_t *shared = (uint32_t *)(pd[pd_idx] & 0xFFFFF000u);
+   uint32_t *pt = alloc_page_table();
+   if (!pt) return NULL;
+
+   memcpy(pt, shared, PAGE_SIZE);
+   pd[pd_idx] = (uint32_t)pt | (pd[pd_idx] & 0xFFFu);
+   return pt;
+}
+
 bool i686_Paging_MapPage(void *page_dir, uint32_t vaddr, uint32_t paddr,
                          uint32_t flags)
 {
@@ -150,6 +276,12 @@ bool i686_Paging_MapPage(void *page_dir, uint32_t vaddr, uint32_t paddr,
    uint32_t *pt = get_page_table(pd, vaddr, true);
    if (!pt) return false;
 
+   if ((flags & PAGE_USER) && !is_private_table(pd, vaddr >> 22))
+   {
+      pt = unshare_page_table(pd, vaddr >> 22);
+      if (!pt) return false;
+   }
+
    uint32_t pt_idx = (vaddr >> 12) & 0x3FF;
    pt[pt_idx] = (paddr & 0xFFFFF000u) | (flags & 0xFFF) | PAGE_PRESENT;
    invlpg(vaddr);
@@ -170,6 +302,10 @@ bool i686_Paging_UnmapPage(void *page_dir, uint32_t vaddr)
 uint32_t i686_Paging_GetPhysicalAddress(void *page_dir, uint32_t vaddr)
 {
    uint32_t *pd = (uint32_t *)page_dir;
+   uint32_t pde = pd[vaddr >> 22];
+   if ((pde & (PAGE_PRESENT | PAGE_LARGE)) == (PAGE_PRESENT | PAGE_LARGE))
+      return (pde & 0xFFC00000u) | (vaddr & 0x3FFFFF);
+
    uint32_t *pt = get_page_table(pd, vaddr, false);
    if (!pt) return 0;
    uint32_t pt_idx = (vaddr >> 12) & 0x3FF;
@@ -183,8 +319,108 @@ bool i686_Paging_IsPageMapped(void *page_dir, uint32_t vaddr)
    return i686_Paging_GetPhysicalAddress(page_dir, vaddr) != 0;
 }
 
+void *i686_Paging_CloneAddressSpace(void *page_dir)
+{
+   uint32_t *src = (uint32_t *)page_dir;
+   uint32_t *dst = i686_Paging_CreatePageDirectory();
+   if (!src || !dst) return NULL;
+
+   for (size_t i = 0; i < PAGE_DIR_ENTRIES; ++i)
+   {
+      if (!is_private_table(src, i)) continue;
+
+      uint32_t *src_pt = (uint32_t *)(src[i] & 0xFFFFF000u);
+      uint32_t *dst_pt = alloc_page_table();
+      if (!dst_pt)
+      {
+         i686_Paging_DestroyPageDirectory(dst);
+         return NULL;
+      }
+
+      // User pages become read-only copy-on-write in both spaces and gain a
+      // reference; kernel entries (split identity pages) are copied as-is.
+      for (size_t j = 0; j < PAGE_TABLE_ENTRIES; ++j)
+      {
+         uint32_t pte = src_pt[j];
+         if ((pte & PAGE_PRESENT) && (pte & PAGE_USER))
+         {
+            if (pte & PAGE_RW) pte = (pte & ~PAGE_RW) | PAGE_COW;
+            src_pt[j] = pte;
+            PMM_RefPage(pte & 0xFFFFF000u);
+         }
+         dst_pt[j] = pte;
+      }
+      dst[i] = (uint32_t)dst_pt | (src[i] & 0xFFFu);
+   }
+
+   // The source lost write access to its user pages
+   if (src == current_page_directory) i686_Paging_FlushTlb();
+   return dst;
+}
+
+bool i686_Paging_HandleCowFault(void *page_dir, uint32_t vaddr)
+{
+   uint32_t *pd = (uint32_t *)page_dir;
+   uint32_t pde = pd[vaddr >> 22];
+   if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) return false;
+
+   uint32_t *pt = (uint32_t *)(pde & 0xFFFFF000u);
+   uint32_t *pte = &pt[(vaddr >> 12) & 0x3FF];
+   if ((*pte & (PAGE_PRESENT | PAGE_COW)) != (PAGE_PRESENT | PAGE_COW))
+      return false;
+
+   uint32_t old_frame = *pte & 0xFFFFF000u;
+   uint32_t flags = (*pte & 0xFFFu & ~PAGE_COW) | PAGE_RW;
+
+   // Last sharer just takes the frame back
+   if (PMM_PageRefCount(old_frame) <= 1)
+   {
+      *pte = old_frame | flags;
+      invlpg(vaddr);
+      return true;
+   }
+
+   // The old contents stay readable at vaddr (faults are resolved in the
+   // active directory); the new frame is filled through the scratch page.
+   if (pd != current_page_directory || !scratch_pte) return false;
+   uint32_t new_frame = PMM_AllocatePhysicalPage();
+   if (!new_frame) return false;
+
+   *scratch_pte = new_frame | PAGE_PRESENT | PAGE_RW;
+   invlpg(SCRATCH_VADDR);
+   memcpy((void *)SCRATCH_VADDR, (const void *)(vaddr & ~(PAGE_SIZE - 1)),
+          PAGE_SIZE);
+   *scratch_pte = 0;
+   invlpg(SCRATCH_VADDR);
+
+   *pte = new_frame | flags;
+   invlpg(vaddr);
+   PMM_FreePhysicalPage(old_frame); // drops this space's reference
+   return true;
+}
+
+void i686_Paging_ZeroPhysicalPage(uint32_t phys)
+{
+   phys &= 0xFFFFF000u;
+   // Before paging is up every frame is directly addressable
+   if (phys < IDENTITY_MAP_LIMIT || !kernel_page_directory)
+   {
+      memset((void *)phys, 0, PAGE_SIZE);
+      return;
+   }
+   if (!scratch_pte) return;
+
+   *scratch_pte = phys | PAGE_PRESENT | PAGE_RW;
+   invlpg(SCRATCH_VADDR);
+   memset((void *)SCRATCH_VADDR, 0, PAGE_SIZE);
+   *scratch_pte = 0;
+   invlpg(SCRATCH_VADDR);
+}
+
 void i686_Paging_PageFaultHandler(uint32_t fault_address, uint32_t error_code)
 {
+   if (VMM_HandlePageFault(fault_address, error_code)) return;
+
    printf("Page fault at 0x%08x, error=0x%x\n", fault_address, error_code);
    printf("  present=%d rw=%d user=%d reserved=%d fetch=%d\n",
           (error_code & 1) != 0, (error_code & 2) != 0, (error_code & 4) != 0,
@@ -193,8 +429,28 @@ void i686_Paging_PageFaultHandler(uint32_t fault_address, uint32_t error_code)
    for (;;) __asm__ __volatile__("hlt");
 }
 
+void i686_Paging_PageFaultIsr(Registers *regs)
+{
+   // A fault can hit the middle of an SSE2 memcpy/memset/memcmp loop (cli
+   // does not hold off exceptions). Demand-zero and COW handling copy whole
+   // pages themselves, so the interrupted loop's XMM registers are saved
+   // around the handler and the retried instruction sees them intact.
+   uint8_t fx_area[512 + 16];
+   uint8_t *fx = (uint8_t *)(((uintptr_t)fx_area + 15) & ~(uintptr_t)15);
+   bool save_sse = mem_uses_sse();
+   if (save_sse) __asm__ __volatile__("fxsave (%0)" : : "r"(fx) : "memory");
+
+   uint32_t cr2;
+   __asm__ __volatile__("mov %%cr2, %0" : "=r"(cr2));
+   i686_Paging_PageFaultHandler(cr2, regs->error);
+
+   if (save_sse) __asm__ __volatile__("fxrstor (%0)" : : "r"(fx) : "memory");
+}
+
 void i686_Paging_InvalidateTlbEntry(uint32_t vaddr) { invlpg(vaddr); }
 
+// Reloading CR3 leaves global (identity window) entries cached; those never
+// change outside of i686_Paging_MapPage/UnmapPage, which use invlpg.
 void i686_Paging_FlushTlb(void) { load_cr3(read_cr3()); }
 
 void i686_Paging_SwitchPageDirectory(void *page_dir)
@@ -211,23 +467,27 @@ void *i686_Paging_GetCurrentPageDirectory(void)
 void *i686_Paging_AllocateKernelPages(int page_count)
 {
    if (page_count <= 0) return NULL;
-   uint32_t first_phys = 0;
-   for (int i = 0; i < page_count; ++i)
-   {
-      uint32_t phys = alloc_frame();
-      if (i == 0) first_phys = phys;
-      // identity map each page to keep it accessible
-      i686_Paging_MapPage(kernel_page_directory, phys, phys,
-                          PAGE_RW | PAGE_PRESENT);
-   }
+
+   // Take the smallest buddy block that fits and hand back the unused tail
+   uint32_t order = 0;
+   while ((1 << order) < page_count) order++;
+   if (order > PMM_MAX_ORDER) return NULL;
+
+   uint32_t first_phys = PMM_AllocateLowContiguous(order);
+   if (!first_phys) return NULL;
+
+   for (int i = page_count; i < (1 << order); ++i)
+      PMM_FreePhysicalPage(first_phys + i * PAGE_SIZE);
+
+   // Low-zone frames are already identity mapped in the kernel directory
    return (void *)first_phys;
 }
 
 void i686_Paging_FreeKernelPages(void *addr, int page_count)
 {
-   // Not implemented for this simple allocator
-   (void)addr;
-   (void)page_count;
+   if (!addr || page_count <= 0) return;
+   for (int i = 0; i < page_count; ++i)
+      PMM_FreePhysicalPage((uint32_t)addr + i * PAGE_SIZE);
 }
 
 void i686_Paging_SelfTest(void)
@@ -263,4 +523,5 @@ void i686_Paging_SelfTest(void)
 
    // Unmap to confirm no crash; ignore result
    i686_Paging_UnmapPage(pd, test_va);
+   i686_Paging_FreeKernelPages(phys_page, 1);
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #ifndef I686_PAGING_H
 #define I686_PAGING_H
 
+#include <arch/i686/cpu/isr.h>
 #include <mem/memdefs.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -11,6 +12,9 @@
 #define PAGE_PRESENT 0x001
 #define PAGE_RW 0x002
 #define PAGE_USER 0x004
+#define PAGE_LARGE 0x080  // PDE only: 4 MiB page (requires CR4.PSE)
+#define PAGE_GLOBAL 0x100 // not flushed on CR3 reload (requires CR4.PGE)
+#define PAGE_COW 0x200    // software bit: read-only copy-on-write user page
 
 // Page table initialization
 void i686_Paging_Initialize(void);
@@ -20,17 +24,25 @@ void i686_Paging_Enable(void);
 void *i686_Paging_CreatePageDirectory(void);
 void i686_Paging_DestroyPageDirectory(void *page_dir);
 
+// Copy-on-write clone of a directory's user mappings
+void *i686_Paging_CloneAddressSpace(void *page_dir);
+bool i686_Paging_HandleCowFault(void *page_dir, uint32_t vaddr);
+
 // Page mapping
 bool i686_Paging_MapPage(void *page_dir, uint32_t vaddr, uint32_t paddr,
                          uint32_t flags);
 bool i686_Paging_UnmapPage(void *page_dir, uint32_t vaddr);
 
+// Clear a physical frame whether or not it is identity mapped
+void i686_Paging_ZeroPhysicalPage(uint32_t phys);
+
 // Page lookup
 uint32_t i686_Paging_GetPhysicalAddress(void *page_dir, uint32_t vaddr);
 bool i686_Paging_IsPageMapped(void *page_dir, uint32_t vaddr);
 
 // Page fault handling
 void i686_Paging_PageFaultHandler(uint32_t fault_address, uint32_t error_code);
+void i686_Paging_PageFaultIsr(Registers *regs); // ISR 14 entry, reads CR2
 
 // TLB management
 void i686_Paging_InvalidateTlbEntry(uint32_t vaddr);
@@ -2,6 +2,7 @@
 
 #include "syscall.h"
 #include <std/stdio.h>
+#include <std/trace.h>
 #include <stdint.h>
 #include <syscall/syscall.h>
 
@@ -17,8 +18,8 @@ void i686_Syscall_IRQ(Registers *regs)
    uint32_t args[6] = {regs->ebx, regs->ecx, regs->edx,
                        regs->esi, regs->edi, regs->ebp};
 
-   printf("[i686_syscall] num=%u, args=[0x%x, 0x%x, 0x%x, ...]\n", syscall_num,
-          args[0], args[1], args[2]);
+   TRACE_DEBUG(SYSCALL, "[i686_syscall] num=%u, args=[0x%x, 0x%x, 0x%x, ...]\n",
+               syscall_num, args[0], args[1], args[2]);
 
    // Call generic dispatcher
    intptr_t result = syscall(syscall_num, args);
@@ -12,6 +12,7 @@
 #define SYS_READ 3
 #define SYS_WRITE 4
 #define SYS_LSEEK 19
+#define SYS_FALLOCATE 324
 
 /* x86 syscall dispatcher entry point
  *
@@ -124,14 +124,51 @@ Process *Process_Create(uint32_t entry_point, bool kernel_mode)
    proc->esi = proc->edi = 0;
    proc->eflags = 0x202; // IF=1 (interrupts enabled)
 
-   // Initialize file descriptors (all NULL, reserved FDs 0/1/2 handled by
-   // syscalls)
-   for (int i = 0; i < 16; ++i) proc->fd_table[i] = NULL;
+   // No descriptor table until the first open (reserved FDs 0/1/2 are
+   // handled by syscalls)
+   proc->fd_table = NULL;
+   proc->fd_capacity = 0;
 
    printf("[process] created: pid=%u, entry=0x%08x\n", proc->pid, entry_point);
    return proc;
 }
 
+Process *Process_Clone(Process *parent)
+{
+   if (!parent || parent->kernel_mode) return NULL;
+
+   Process *proc = (Process *)kmalloc(sizeof(Process));
+   if (!proc)
+   {
+      printf("[process] clone: kmalloc failed\n");
+      return NULL;
+   }
+
+   // Same registers, heap and stack layout; user pages are shared
+   // copy-on-write until either side writes to them
+   *proc = *parent;
+   proc->page_directory =
+       HAL_Paging_CloneAddressSpace(parent->page_directory);
+   if (!proc->page_directory)
+   {
+      printf("[process] clone: HAL_Paging_CloneAddressSpace failed\n");
+      free(proc);
+      return NULL;
+   }
+
+   proc->pid = next_pid++;
+   proc->ppid = parent->pid;
+   proc->state = 0; // READY
+   proc->exit_code = 0;
+
+   // Descriptors own their file handles, so they are not inherited yet
+   proc->fd_table = NULL;
+   proc->fd_capacity = 0;
+
+   printf("[process] cloned: pid=%u from pid=%u\n", proc->pid, parent->pid);
+   return proc;
+}
+
 void Process_Destroy(Process *proc)
 {
    if (!proc) return;
@@ -249,6 +286,33 @@ void process_self_test(void)
       return;
    }
 
-   printf("[process] self-test: PASS (pid=%u, heap+stack ok)\n", p->pid);
+   // Clone: the child sees the parent's data, and its writes stay private
+   Process *c = Process_Clone(p);
+   if (!c)
+   {
+      printf("[process] self-test: FAIL (Process_Clone returned NULL)\n");
+      Process_SetCurrent(NULL);
+      Process_Destroy(p);
+      return;
+   }
+
+   Process_SetCurrent(c);
+   volatile uint32_t *child_heap = (volatile uint32_t *)c->heap_start;
+   uint32_t cval = *child_heap;
+   *child_heap = 0x0BADF00Du;
+   Process_SetCurrent(p);
+   uint32_t pval = *heap_test;
+   Process_SetCurrent(NULL);
+   Process_Destroy(c);
+
+   if (cval != 0xCAFEBABEu || pval != 0xCAFEBABEu)
+   {
+      printf("[process] self-test: FAIL (copy-on-write clone)\n");
+      Process_Destroy(p);
+      return;
+   }
+
+   printf("[process] self-test: PASS (pid=%u, heap+stack+cow ok)\n",
+          p->pid);
    Process_Destroy(p);
 }
\ No newline at end of file
@@ -33,7 +33,8 @@ typedef struct
    uint32_t eflags;             // Flags register
 
    // File descriptors
-   void *fd_table[16]; // Open file descriptors (per-process)
+   void **fd_table;      // Open file descriptors, grown on demand
+   uint32_t fd_capacity; // Slots in fd_table
 
    // Scheduling
    uint32_t priority;        // Priority level
@@ -48,6 +49,7 @@ typedef struct
 
 /* Process lifecycle */
 Process *Process_Create(uint32_t entry_point, bool kernel_mode);
+Process *Process_Clone(Process *parent); // fork-style, copy-on-write
 void Process_Destroy(Process *proc);
 Process *Process_GetCurrent(void);
 void Process_SetCurrent(Process *proc);
@@ -1,7 +1,14 @@
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
 #include "ata.h"
+#include <drivers/pci/pci.h>
 #include <hal/io.h>
+#include <hal/irq.h>
+#include <mem/memdefs.h>
+#include <mem/memory.h>
+#include <mem/pmm.h>
+#include <std/stdio.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 // ATA register offsets from base port
@@ -19,13 +26,81 @@
 // ATA status bits
 #define ATA_STATUS_BSY 0x80  // Busy
 #define ATA_STATUS_DRDY 0x40 // Device ready
+#define ATA_STATUS_DF 0x20   // Device fault
 #define ATA_STATUS_DRQ 0x08  // Data request
 #define ATA_STATUS_ERR 0x01  // Error
 
 // ATA commands
-#define ATA_CMD_READ_PIO 0x20  // 28-bit LBA read
-#define ATA_CMD_WRITE_PIO 0x30 // 28-bit LBA write
-#define ATA_CMD_IDENTIFY 0xEC  // Identify device
+#define ATA_CMD_READ_PIO 0x20      // 28-bit LBA read
+#define ATA_CMD_WRITE_PIO 0x30     // 28-bit LBA write
+#define ATA_CMD_READ_MULTIPLE 0xC4 // 28-bit LBA read, one DRQ per block
+#define ATA_CMD_WRITE_MULTIPLE 0xC5
+#define ATA_CMD_SET_MULTIPLE 0xC6 // Set sectors per DRQ block
+#define ATA_CMD_READ_DMA 0xC8     // 28-bit LBA bus-master read
+#define ATA_CMD_WRITE_DMA 0xCA    // 28-bit LBA bus-master write
+#define ATA_CMD_IDENTIFY 0xEC     // Identify device
+
+// 48-bit LBA (EXT) variants
+#define ATA_CMD_READ_PIO_EXT 0x24
+#define ATA_CMD_READ_DMA_EXT 0x25
+#define ATA_CMD_READ_MULTIPLE_EXT 0x29
+#define ATA_CMD_WRITE_PIO_EXT 0x34
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+#define ATA_CMD_WRITE_MULTIPLE_EXT 0x39
+
+// First sector a 28-bit command can't reach
+#define ATA_LBA28_LIMIT 0x10000000u
+
+// Device control register bits
+#define ATA_DCR_SRST 0x04 // Software reset
+
+// IDENTIFY DEVICE word offsets
+#define ATA_IDENT_MAX_MULTIPLE 47 // Low byte: max sectors per DRQ block
+#define ATA_IDENT_CAPABILITIES 49  // Bit 8: DMA supported
+#define ATA_IDENT_LBA28_SECTORS 60 // Words 60-61: 28-bit addressable sectors
+#define ATA_IDENT_COMMAND_SETS 83  // Bit 10: 48-bit address feature set
+#define ATA_IDENT_LBA48_SECTORS 100 // Words 100-103: 48-bit sector count
+
+// Largest DRQ block we ask for; drives commonly support 16
+#define ATA_MAX_MULTIPLE 16
+
+// Status polls before giving up. Each poll is an ISA bus read (~1us), so this
+// is on the order of a second.
+#define ATA_TIMEOUT_POLLS 1000000
+
+// Bus-master IDE registers, relative to the channel's BMIDE base (BAR4 + 8 *
+// channel)
+#define ATA_BM_COMMAND 0x00
+#define ATA_BM_STATUS 0x02
+#define ATA_BM_PRDT 0x04
+
+#define ATA_BM_CMD_START 0x01
+#define ATA_BM_CMD_READ 0x08 // Transfer direction: device to memory
+
+#define ATA_BM_STATUS_ACTIVE 0x01
+#define ATA_BM_STATUS_ERROR 0x02
+#define ATA_BM_STATUS_IRQ 0x04
+
+// Physical region descriptor. A region may not cross a 64 KiB boundary; a
+// byte count of 0 means 64 KiB.
+typedef struct
+{
+   uint32_t address;
+   uint16_t byte_count;
+   uint16_t flags; // Bit 15: last entry in the table
+} __attribute__((packed)) ata_prd_t;
+
+#define ATA_PRD_LAST 0x8000
+#define ATA_PRD_MAX_BYTES 0x10000
+
+// DMA bounce buffer: one physically contiguous, naturally aligned buddy block
+// large enough for a full ATA_MAX_COMMAND_SECTORS request (2 x 64 KiB regions)
+#define ATA_DMA_BUFFER_ORDER 5
+#define ATA_DMA_BUFFER_SIZE (PAGE_SIZE << ATA_DMA_BUFFER_ORDER)
+
+// Timer interrupts (1 kHz) to wait for a completion interrupt before giving
+// up on it
+#define ATA_IRQ_TIMEOUT_WAKEUPS 5000
 
 // Driver data structure
 typedef struct
@@ -35,6 +110,11 @@ typedef struct
    uint16_t dcr_port;         // Alt status/DCR port
    uint16_t tf_port;          // Task file base port
    uint8_t slave_bits;        // Master/slave bits (0xA0 or 0xB0)
+   uint8_t multiple; // Sectors per DRQ block (0 = READ/WRITE MULTIPLE off)
+   uint8_t channel;  // Index into ata_channels
+   bool dma;         // Use bus-master DMA for transfers
+   bool lba48;       // Drive supports the 48-bit command set
+   uint64_t sectors; // Capacity reported by IDENTIFY
 } ata_driver_t;
 
 // Global driver instances
@@ -42,25 +122,52 @@ static ata_driver_t primary_master = {.partition_length = 0x100000,
                                       .start_lba = 0,
                                       .dcr_port = 0x3F6,
                                       .tf_port = 0x1F0,
-                                      .slave_bits = 0xA0};
+                                      .slave_bits = 0xA0,
+                                      .channel = 0};
 
 static ata_driver_t primary_slave = {.partition_length = 0x100000,
                                      .start_lba = 0,
                                      .dcr_port = 0x3F6,
                                      .tf_port = 0x1F0,
-                                     .slave_bits = 0xB0};
+                                     .slave_bits = 0xB0,
+                                     .channel = 0};
 
 static ata_driver_t secondary_master = {.partition_length = 0x100000,
                                         .start_lba = 0,
                                         .dcr_port = 0x376,
                                         .tf_port = 0x170,
-                                        .slave_bits = 0xA0};
+                                        .slave_bits = 0xA0,
+                                        .channel = 1};
 
 static ata_driver_t secondary_slave = {.partition_length = 0x100000,
                                        .start_lba = 0,
                                        .dcr_port = 0x376,
                                        .tf_port = 0x170,
-                                       .slave_bits = 0xB0};
+                                       .slave_bits = 0xB0,
+                                       .channel = 1};
+
+// Per-channel state. A channel runs one command at a time; the in-flight
+// request is advanced by the channel's IRQ handler.
+typedef struct
+{
+   uint16_t bmide;      // Bus-master register base, 0 if no DMA
+   int irq;             // Legacy IRQ line (14 or 15)
+   bool irq_registered; // Completion interrupts are wired up
+   bool polled;         // Run commands with polled PIO, see ATA_SetPolled
+   uint32_t prdt;       // Physical address of the PRD table
+   uint32_t buffer;     // Physical address of the DMA bounce buffer
+
+   ATA_Request *active; // In-flight request, NULL when idle
+   ata_driver_t *active_drv;
+   bool active_dma;         // Transfer uses the bus-master engine
+   bool active_lba48;       // Transfer uses EXT commands
+   uint32_t count;          // Sectors in the request
+   uint32_t done;           // Sectors moved so far (PIO)
+   uint32_t segment;        // PIO scatter cursor: segment index...
+   uint32_t segment_offset; // ...and sectors already used from it
+} ata_channel_t;
+
+static ata_channel_t ata_channels[2] = {{.irq = 14}, {.irq = 15}};
 
 /**
  * Get driver for channel and drive
@@ -74,46 +181,42 @@ static ata_driver_t *ata_get_driver(int channel, int drive)
    return NULL;
 }
 
+/**
+ * Wait ~400ns for the status register to become valid after a command or
+ * drive select. Each alternate status read takes ~100ns on the ISA bus and,
+ * unlike the status register, does not acknowledge a pending interrupt.
+ */
+static void ata_delay_400ns(uint16_t dcr_port)
+{
+   for (int i = 0; i < 4; i++) HAL_inb(dcr_port);
+}
+
 /**
  * Wait for drive to be ready (not busy)
  */
 static int ata_wait_busy(uint16_t tf_port)
 {
-   // Timeout: ~1 second at 1MHz CPU (~1 million iterations per ms)
-   // Each iteration reads status register, so adjust based on CPU speed
-   int timeout = 10000; // Much shorter timeout
-
-   while (timeout--)
+   for (int timeout = ATA_TIMEOUT_POLLS; timeout > 0; timeout--)
    {
       uint8_t status = HAL_inb(tf_port + ATA_REG_STATUS);
       if (!(status & ATA_STATUS_BSY)) return 0;
-
-      // Small delay to prevent bus saturation
-      for (volatile int i = 0; i < 100; i++);
    }
 
    return -1; // Timeout
 }
 
 /**
- * Wait for data ready
+ * Wait for data ready. The other status bits are only meaningful once BSY
+ * has cleared.
  */
 static int ata_wait_drq(uint16_t tf_port)
 {
-   // Timeout: similar to wait_busy
-   int timeout = 10000;
-
-   while (timeout--)
+   for (int timeout = ATA_TIMEOUT_POLLS; timeout > 0; timeout--)
    {
       uint8_t status = HAL_inb(tf_port + ATA_REG_STATUS);
+      if (status & ATA_STATUS_BSY) continue;
+      if (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) return -1;
       if (status & ATA_STATUS_DRQ) return 0;
-      if (status & ATA_STATUS_ERR)
-      {
-         return -1;
-      }
-
-      // Small delay
-      for (volatile int i = 0; i < 100; i++);
    }
 
    return -1; // Timeout
@@ -122,188 +225,737 @@ static int ata_wait_drq(uint16_t tf_port)
 /**
  * Perform software reset on ATA channel
  */
-static void ata_soft_reset(uint16_t dcr_port)
+static void ata_soft_reset(uint16_t dcr_port, uint16_t tf_port)
 {
-   // Set SRST bit (software reset)
-   HAL_outb(dcr_port, 0x04);
-
-   // Wait a bit
-   for (volatile int i = 0; i < 100000; i++);
+   // SRST must be held for at least 5us
+   HAL_outb(dcr_port, ATA_DCR_SRST);
+   for (int i = 0; i < 13; i++) ata_delay_400ns(dcr_port);
 
-   // Clear SRST bit
+   // Clear SRST and wait for the drives to come out of reset
    HAL_outb(dcr_port, 0x00);
+   ata_delay_400ns(dcr_port);
+   ata_wait_busy(tf_port);
+}
 
-   // Wait for reset to complete
-   for (volatile int i = 0; i < 100000; i++);
+/**
+ * Opcode for a transfer in the given mode
+ */
+static uint8_t ata_command(ata_driver_t *drv, bool write, bool dma,
+                           bool lba48)
+{
+   if (dma)
+   {
+      if (lba48) return write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+      return write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA;
+   }
+   if (drv->multiple)
+   {
+      if (lba48)
+         return write ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE_EXT;
+      return write ? ATA_CMD_WRITE_MULTIPLE : ATA_CMD_READ_MULTIPLE;
+   }
+   if (lba48) return write ? ATA_CMD_WRITE_PIO_EXT : ATA_CMD_READ_PIO_EXT;
+   return write ? ATA_CMD_WRITE_PIO : ATA_CMD_READ_PIO;
 }
 
 /**
- * Initialize ATA driver for a specific drive
+ * Whether a transfer needs the 48-bit command set: 28-bit commands address
+ * sectors below 2^28 only. Counts up to 256 fit both (256 encodes as 0).
  */
-void ATA_Init(int channel, int drive, uint32_t partition_start,
-              uint32_t partition_size)
+static bool ata_needs_lba48(uint32_t lba, uint32_t count)
 {
-   ata_driver_t *drv = ata_get_driver(channel, drive);
-   if (!drv) return;
+   return (uint64_t)lba + count > ATA_LBA28_LIMIT;
+}
 
-   drv->start_lba = 0; // We use absolute LBA
-   drv->partition_length = partition_size;
+/**
+ * Select the drive, program the task file (28- or 48-bit LBA), then issue
+ * command.
+ */
+static int ata_issue(ata_driver_t *drv, uint32_t lba, uint32_t count,
+                     uint8_t command, bool lba48)
+{
+   // Prepare device register value with master/slave bits, LBA flag, and upper
+   // LBA bits (bits 24-27, 28-bit mode only) Note: must set the LBA bit (0x40)
+   // when using LBA addressing, otherwise the device may ABRT.
+   uint8_t device = drv->slave_bits | 0x40;
+   if (!lba48) device |= (lba >> 24) & 0x0F;
 
-   // Perform software reset
-   ata_soft_reset(drv->dcr_port);
+   HAL_outb(drv->tf_port + ATA_REG_DEVICE, device);
+   ata_delay_400ns(drv->dcr_port);
+
+   // Wait for drive to be ready
+   if (ata_wait_busy(drv->tf_port) != 0) return -1;
+
+   if (lba48)
+   {
+      // The registers are two-deep FIFOs: high order bytes go in first.
+      // LBA bits 32-47 are always zero with 32-bit sector addresses.
+      HAL_outb(drv->tf_port + ATA_REG_NSECTOR, (count >> 8) & 0xFF);
+      HAL_outb(drv->tf_port + ATA_REG_LBA_LOW, (lba >> 24) & 0xFF);
+      HAL_outb(drv->tf_port + ATA_REG_LBA_MID, 0);
+      HAL_outb(drv->tf_port + ATA_REG_LBA_HIGH, 0);
+   }
+   HAL_outb(drv->tf_port + ATA_REG_NSECTOR, count & 0xFF);
+   HAL_outb(drv->tf_port + ATA_REG_LBA_LOW, (lba & 0xFF));
+   HAL_outb(drv->tf_port + ATA_REG_LBA_MID, ((lba >> 8) & 0xFF));
+   HAL_outb(drv->tf_port + ATA_REG_LBA_HIGH, ((lba >> 16) & 0xFF));
+   HAL_outb(drv->tf_port + ATA_REG_COMMAND, command);
+
+   // Status is not valid until 400ns after the command
+   ata_delay_400ns(drv->dcr_port);
+   return 0;
 }
 
 /**
- * Read sectors from ATA drive using PIO mode (28-bit LBA)
+ * Issue IDENTIFY DEVICE and read the 256-word response. Returns false if no
+ * ATA drive answers at this position.
  */
-int ATA_Read(int channel, int drive, uint32_t lba, uint8_t *buffer,
-             uint32_t count)
+static bool ata_identify(ata_driver_t *drv, uint16_t *ident)
 {
-   ata_driver_t *drv = ata_get_driver(channel, drive);
-   if (!drv || !buffer || count == 0) return -1;
+   HAL_outb(drv->tf_port + ATA_REG_DEVICE, drv->slave_bits);
+   ata_delay_400ns(drv->dcr_port);
+   HAL_outb(drv->tf_port + ATA_REG_NSECTOR, 0);
+   HAL_outb(drv->tf_port + ATA_REG_LBA_LOW, 0);
+   HAL_outb(drv->tf_port + ATA_REG_LBA_MID, 0);
+   HAL_outb(drv->tf_port + ATA_REG_LBA_HIGH, 0);
+   HAL_outb(drv->tf_port + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+   ata_delay_400ns(drv->dcr_port);
+
+   // Status 0 means no drive on this position
+   if (HAL_inb(drv->tf_port + ATA_REG_STATUS) == 0) return false;
+   if (ata_wait_drq(drv->tf_port) != 0) return false;
+   HAL_insw(drv->tf_port + ATA_REG_DATA, ident, 256);
+   return true;
+}
+
+/**
+ * Enable READ/WRITE MULTIPLE with the largest block size the drive supports
+ * (capped at ATA_MAX_MULTIPLE). Leaves drv->multiple at 0 if the drive does
+ * not support it.
+ */
+static void ata_setup_multiple(ata_driver_t *drv, const uint16_t *ident)
+{
+   drv->multiple = 0;
+
+   uint8_t max_multiple = ident[ATA_IDENT_MAX_MULTIPLE] & 0xFF;
+   if (max_multiple == 0) return;
+
+   // Largest power of two the drive accepts, up to our cap
+   uint8_t block = ATA_MAX_MULTIPLE;
+   while (block > max_multiple) block >>= 1;
+   if (block < 2) return;
 
-   // Limit to 255 sectors per read (8-bit sector count)
-   if (count > 255)
+   HAL_outb(drv->tf_port + ATA_REG_NSECTOR, block);
+   HAL_outb(drv->tf_port + ATA_REG_COMMAND, ATA_CMD_SET_MULTIPLE);
+   ata_delay_400ns(drv->dcr_port);
+   if (ata_wait_busy(drv->tf_port) != 0) return;
+   if (HAL_inb(drv->tf_port + ATA_REG_STATUS) & ATA_STATUS_ERR) return;
+
+   drv->multiple = block;
+}
+
+/**
+ * Locate the PCI IDE controller's bus-master registers for a channel and set
+ * up its PRD table and bounce buffer. Only channels in legacy (compatibility)
+ * mode are used, since those are the ones wired to IRQ 14/15.
+ */
+static bool ata_dma_init_channel(int channel)
+{
+   ata_channel_t *ch = &ata_channels[channel];
+   if (ch->bmide) return true;
+
+   PCI_Address pci;
+   if (!PCI_FindClass(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &pci)) return false;
+
+   uint8_t prog_if = (PCI_ConfigRead32(pci, PCI_REG_CLASS) >> 8) & 0xFF;
+   uint8_t native_bit = channel == 0 ? 0x01 : 0x04;
+   if (!(prog_if & 0x80) || (prog_if & native_bit)) return false;
+
+   uint32_t bar4 = PCI_ConfigRead32(pci, PCI_REG_BAR4);
+   if (!(bar4 & 1) || (bar4 & 0xFFFC) == 0) return false; // Not an I/O BAR
+
+   uint32_t prdt = PMM_AllocateLowPage();
+   uint32_t buffer = PMM_AllocateLowContiguous(ATA_DMA_BUFFER_ORDER);
+   if (!prdt || !buffer)
    {
-      count = 255;
+      if (prdt) PMM_FreePhysicalPage(prdt);
+      if (buffer) PMM_FreeContiguous(buffer, ATA_DMA_BUFFER_ORDER);
+      return false;
    }
 
-   // Wait for drive to be ready
-   if (ata_wait_busy(drv->tf_port) != 0)
+   uint16_t command = PCI_ConfigRead16(pci, PCI_REG_COMMAND);
+   PCI_ConfigWrite16(pci, PCI_REG_COMMAND,
+                     command | PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+
+   ch->bmide = (uint16_t)((bar4 & 0xFFFC) + channel * 8);
+   ch->prdt = prdt;
+   ch->buffer = buffer;
+
+   printf("[ata] channel %d: bus-master DMA at 0x%x\n", channel, ch->bmide);
+   return true;
+}
+
+/**
+ * Next sector-sized slice of the in-flight request's scatter list
+ */
+static uint8_t *ata_next_sector(ata_channel_t *ch)
+{
+   ATA_Request *req = ch->active;
+   while (ch->segment_offset == req->segments[ch->segment].count)
    {
-      return -1;
+      ch->segment++;
+      ch->segment_offset = 0;
    }
+   return req->segments[ch->segment].buffer +
+          ch->segment_offset++ * ATA_SECTOR_SIZE;
+}
 
-   // Prepare device register value with master/slave bits, LBA flag, and upper
-   // LBA bits (bits 24-27) Note: must set the LBA bit (0x40) when using LBA
-   // addressing, otherwise the device may ABRT.
-   uint8_t device = drv->slave_bits | 0x40 | ((lba >> 24) & 0x0F);
+/**
+ * Move the next DRQ block of a PIO request (at most drv->multiple sectors)
+ */
+static void ata_pio_block(ata_channel_t *ch)
+{
+   ata_driver_t *drv = ch->active_drv;
+   uint32_t block = drv->multiple ? drv->multiple : 1;
+   uint32_t n = ch->count - ch->done < block ? ch->count - ch->done : block;
 
-   // Write all command registers in the correct sequence
-   // This is critical - must follow ATA protocol
-   HAL_outb(drv->tf_port + ATA_REG_NSECTOR, count & 0xFF);
-   HAL_outb(drv->tf_port + ATA_REG_LBA_LOW, (lba & 0xFF));
-   HAL_outb(drv->tf_port + ATA_REG_LBA_MID, ((lba >> 8) & 0xFF));
-   HAL_outb(drv->tf_port + ATA_REG_LBA_HIGH, ((lba >> 16) & 0xFF));
-   HAL_outb(drv->tf_port + ATA_REG_DEVICE, device);
+   for (uint32_t i = 0; i < n; i++)
+   {
+      uint8_t *sector = ata_next_sector(ch);
+      if (ch->active->write)
+         HAL_outsw(drv->tf_port + ATA_REG_DATA, sector, ATA_SECTOR_SIZE / 2);
+      else
+         HAL_insw(drv->tf_port + ATA_REG_DATA, sector, ATA_SECTOR_SIZE / 2);
+   }
+   ch->done += n;
+}
 
-   // Small delay to allow registers to settle
-   for (volatile int i = 0; i < 50000; i++);
+/**
+ * Copy between the scatter list and the DMA bounce buffer
+ */
+static void ata_copy_bounce(ata_channel_t *ch, bool to_bounce)
+{
+   ATA_Request *req = ch->active;
+   uint8_t *bounce = (uint8_t *)ch->buffer;
 
-   // Issue READ SECTORS command
-   HAL_outb(drv->tf_port + ATA_REG_COMMAND, ATA_CMD_READ_PIO);
+   for (uint32_t i = 0; i < req->segment_count; i++)
+   {
+      uint32_t bytes = req->segments[i].count * ATA_SECTOR_SIZE;
+      if (to_bounce)
+         memcpy(bounce, req->segments[i].buffer, bytes);
+      else
+         memcpy(req->segments[i].buffer, bounce, bytes);
+      bounce += bytes;
+   }
+}
 
-   // Read sectors
-   for (uint32_t sec = 0; sec < count; sec++)
+/**
+ * Retire the in-flight request. The channel is idle again before the
+ * callback runs, so the callback may submit the next request.
+ */
+static void ata_complete(ata_channel_t *ch, int status)
+{
+   ATA_Request *req = ch->active;
+   ch->active = NULL;
+   ch->active_drv = NULL;
+   if (req && req->done) req->done(req, status);
+}
+
+/**
+ * Program the PRD table over the bounce buffer and start a DMA command
+ */
+static int ata_start_dma(ata_channel_t *ch, ata_driver_t *drv,
+                         ATA_Request *req)
+{
+   uint32_t bytes = ch->count * ATA_SECTOR_SIZE;
+   uint8_t direction = req->write ? 0 : ATA_BM_CMD_READ;
+
+   // The bounce buffer is naturally aligned, so 64 KiB regions never cross
+   // a 64 KiB boundary
+   ata_prd_t *prdt = (ata_prd_t *)ch->prdt;
+   uint32_t entries = 0;
+   for (uint32_t off = 0; off < bytes; off += ATA_PRD_MAX_BYTES)
    {
-      // Wait for data ready or error
-      if (ata_wait_drq(drv->tf_port) != 0)
+      uint32_t len = bytes - off;
+      if (len > ATA_PRD_MAX_BYTES) len = ATA_PRD_MAX_BYTES;
+      prdt[entries].address = ch->buffer + off;
+      prdt[entries].byte_count = (uint16_t)len; // 64 KiB encodes as 0
+      prdt[entries].flags = 0;
+      entries++;
+   }
+   prdt[entries - 1].flags = ATA_PRD_LAST;
+
+   if (req->write) ata_copy_bounce(ch, true);
+
+   HAL_outb(ch->bmide + ATA_BM_COMMAND, direction);
+   HAL_outl(ch->bmide + ATA_BM_PRDT, ch->prdt);
+   HAL_outb(ch->bmide + ATA_BM_STATUS, ATA_BM_STATUS_IRQ | ATA_BM_STATUS_ERROR);
+
+   uint8_t command = ata_command(drv, req->write, true, ch->active_lba48);
+   if (ata_issue(drv, req->lba, ch->count, command, ch->active_lba48) != 0)
+      return -1;
+   HAL_outb(ch->bmide + ATA_BM_COMMAND, direction | ATA_BM_CMD_START);
+   return 0;
+}
+
+/**
+ * Start a READ/WRITE MULTIPLE command. The IRQ handler moves each DRQ block;
+ * for writes the first block goes out here, as the drive only interrupts
+ * after it has taken a block.
+ */
+static int ata_start_pio(ata_channel_t *ch, ata_driver_t *drv,
+                         ATA_Request *req)
+{
+   uint8_t command = ata_command(drv, req->write, false, ch->active_lba48);
+   if (ata_issue(drv, req->lba, ch->count, command, ch->active_lba48) != 0)
+      return -1;
+
+   if (req->write)
+   {
+      if (ata_wait_drq(drv->tf_port) != 0) return -1;
+      ata_pio_block(ch);
+   }
+   return 0;
+}
+
+/**
+ * Channel interrupt: advance or retire the in-flight request. The status
+ * register read acknowledges the drive's interrupt; the BM status IRQ bit is
+ * write-1-to-clear.
+ */
+static void ata_irq(int channel)
+{
+   ata_channel_t *ch = &ata_channels[channel];
+   uint16_t tf_port = channel == 0 ? 0x1F0 : 0x170;
+
+   if (!ch->active)
+   {
+      // Left over from a polled command
+      HAL_inb(tf_port + ATA_REG_STATUS);
+      if (ch->bmide)
+         HAL_outb(ch->bmide + ATA_BM_STATUS,
+                  ATA_BM_STATUS_IRQ | ATA_BM_STATUS_ERROR);
+      return;
+   }
+
+   if (ch->active_dma)
+   {
+      uint8_t bm_status = HAL_inb(ch->bmide + ATA_BM_STATUS);
+      if (!(bm_status & ATA_BM_STATUS_IRQ))
       {
-         return -1;
+         HAL_inb(tf_port + ATA_REG_STATUS);
+         return;
       }
 
-      // Read 512 bytes (256 words) from data port using 16-bit reads
-      uint8_t *dest = buffer + (sec * 512);
-      uint16_t *dest_words = (uint16_t *)dest;
-      for (int i = 0; i < 256; i++)
+      HAL_outb(ch->bmide + ATA_BM_COMMAND, 0); // Stop the engine
+      HAL_outb(ch->bmide + ATA_BM_STATUS, ATA_BM_STATUS_IRQ | ATA_BM_STATUS_ERROR);
+      uint8_t status = HAL_inb(tf_port + ATA_REG_STATUS);
+
+      if ((bm_status & ATA_BM_STATUS_ERROR) ||
+          (status & (ATA_STATUS_ERR | ATA_STATUS_DF)))
       {
-         // Read 16-bit word from data port
-         dest_words[i] = HAL_inw(drv->tf_port + ATA_REG_DATA);
+         ata_complete(ch, -1);
+         return;
       }
+      if (!ch->active->write) ata_copy_bounce(ch, false);
+      ata_complete(ch, 0);
+      return;
    }
 
-   return 0;
+   uint8_t status = HAL_inb(tf_port + ATA_REG_STATUS);
+   if (status & ATA_STATUS_BSY) return;
+   if (status & (ATA_STATUS_ERR | ATA_STATUS_DF))
+   {
+      ata_complete(ch, -1);
+      return;
+   }
+
+   // Writes interrupt after each block is committed, reads when a block is
+   // ready to be taken
+   if (ch->active->write && ch->done == ch->count)
+   {
+      ata_complete(ch, 0);
+      return;
+   }
+   if (!(status & ATA_STATUS_DRQ)) return;
+
+   ata_pio_block(ch);
+   if (!ch->active->write && ch->done == ch->count) ata_complete(ch, 0);
+}
+
+static void ata_irq_primary(Registers *regs)
+{
+   (void)regs;
+   ata_irq(0);
+}
+
+static void ata_irq_secondary(Registers *regs)
+{
+   (void)regs;
+   ata_irq(1);
 }
 
 /**
- * Write sectors to ATA drive using PIO mode (28-bit LBA)
+ * Wire up the channel's completion interrupt
  */
-int ATA_Write(int channel, int drive, uint32_t lba, const uint8_t *buffer,
-              uint32_t count)
+static void ata_init_irq(int channel)
 {
-   ata_driver_t *drv = ata_get_driver(channel, drive);
-   if (!drv || !buffer || count == 0) return -1;
+   ata_channel_t *ch = &ata_channels[channel];
+   if (ch->irq_registered) return;
+
+   HAL_IRQ_RegisterHandler(ch->irq,
+                           channel == 0 ? ata_irq_primary : ata_irq_secondary);
+   HAL_IRQ_Unmask(ch->irq);
+   ch->irq_registered = true;
+}
 
-   // Limit to 255 sectors per write (8-bit sector count)
-   if (count > 255)
+static int ata_pio_read(ata_driver_t *drv, uint32_t lba, uint8_t *buffer,
+                        uint32_t count);
+static int ata_pio_write(ata_driver_t *drv, uint32_t lba, const uint8_t *buffer,
+                         uint32_t count);
+
+// Move a request's segments one after the other with polled PIO
+static int ata_run_polled(ata_driver_t *drv, ATA_Request *req)
+{
+   uint32_t lba = req->lba;
+   for (uint32_t i = 0; i < req->segment_count; i++)
    {
-      count = 255;
+      uint8_t *buffer = req->segments[i].buffer;
+      uint32_t count = req->segments[i].count;
+      int rc = req->write ? ata_pio_write(drv, lba, buffer, count)
+                          : ata_pio_read(drv, lba, buffer, count);
+      if (rc != 0) return -1;
+      lba += count;
    }
+   return 0;
+}
 
-   // Wait for drive to be ready
-   if (ata_wait_busy(drv->tf_port) != 0)
+int ATA_Submit(ATA_Request *req)
+{
+   if (!req || req->segment_count == 0 ||
+       req->segment_count > ATA_MAX_SEGMENTS)
+      return -1;
+
+   ata_driver_t *drv = ata_get_driver(req->channel, req->drive);
+   if (!drv) return -1;
+
+   uint32_t count = 0;
+   for (uint32_t i = 0; i < req->segment_count; i++)
+   {
+      if (!req->segments[i].buffer || req->segments[i].count == 0) return -1;
+      count += req->segments[i].count;
+   }
+   if (count > ATA_MAX_COMMAND_SECTORS) return -1;
+   bool lba48 = ata_needs_lba48(req->lba, count);
+   if (lba48 && !drv->lba48) return -1;
+
+   ata_channel_t *ch = &ata_channels[drv->channel];
+   if (ch->polled)
+   {
+      // Completion interrupts are not trusted: finish the command here. The
+      // request is not touched again once its callback has run.
+      if (ch->active) return -1;
+      int status = ata_run_polled(drv, req);
+      if (req->done) req->done(req, status);
+      return 0;
+   }
+   if (!ch->irq_registered) return -1;
+
+   uint32_t flags = HAL_SaveInterrupts();
+   if (ch->active)
    {
+      HAL_RestoreInterrupts(flags);
       return -1;
    }
 
-   // Prepare device register value with master/slave bits, LBA flag, and upper
-   // LBA bits (bits 24-27)
-   uint8_t device = drv->slave_bits | 0x40 | ((lba >> 24) & 0x0F);
+   ch->active = req;
+   ch->active_drv = drv;
+   ch->active_dma = drv->dma;
+   ch->active_lba48 = lba48;
+   ch->count = count;
+   ch->done = 0;
+   ch->segment = 0;
+   ch->segment_offset = 0;
+
+   int rc = ch->active_dma ? ata_start_dma(ch, drv, req)
+                           : ata_start_pio(ch, drv, req);
+   if (rc != 0)
+   {
+      if (ch->active_dma) HAL_outb(ch->bmide + ATA_BM_COMMAND, 0);
+      ch->active = NULL;
+      ch->active_drv = NULL;
+   }
 
-   // Write all command registers in the correct sequence
-   HAL_outb(drv->tf_port + ATA_REG_NSECTOR, count & 0xFF);
-   HAL_outb(drv->tf_port + ATA_REG_LBA_LOW, (lba & 0xFF));
-   HAL_outb(drv->tf_port + ATA_REG_LBA_MID, ((lba >> 8) & 0xFF));
-   HAL_outb(drv->tf_port + ATA_REG_LBA_HIGH, ((lba >> 16) & 0xFF));
-   HAL_outb(drv->tf_port + ATA_REG_DEVICE, device);
+   HAL_RestoreInterrupts(flags);
+   return rc;
+}
 
-   // Small delay to allow registers to settle
-   for (volatile int i = 0; i < 50000; i++);
+/**
+ * Identify the drive and pick its transfer modes
+ */
+static void ata_configure(ata_driver_t *drv)
+{
+   uint16_t ident[256];
 
-   // Issue WRITE SECTORS command
-   HAL_outb(drv->tf_port + ATA_REG_COMMAND, ATA_CMD_WRITE_PIO);
+   drv->multiple = 0;
+   drv->dma = false;
+   drv->lba48 = false;
+   drv->sectors = 0;
+   if (!ata_identify(drv, ident)) return;
 
-   // Write sectors
-   for (uint32_t sec = 0; sec < count; sec++)
+   drv->sectors = ident[ATA_IDENT_LBA28_SECTORS] |
+                  ((uint32_t)ident[ATA_IDENT_LBA28_SECTORS + 1] << 16);
+   if (ident[ATA_IDENT_COMMAND_SETS] & 0x400)
    {
-      // Wait for drive ready to accept data
+      drv->lba48 = true;
+      drv->sectors = 0;
+      for (int i = 3; i >= 0; i--)
+         drv->sectors = (drv->sectors << 16) | ident[ATA_IDENT_LBA48_SECTORS + i];
+   }
+
+   ata_setup_multiple(drv, ident);
+   if ((ident[ATA_IDENT_CAPABILITIES] & 0x100) &&
+       ata_dma_init_channel(drv->channel))
+   {
+      drv->dma = true;
+   }
+}
+
+/**
+ * Initialize ATA driver for a specific drive
+ */
+void ATA_Init(int channel, int drive, uint32_t partition_start,
+              uint32_t partition_size)
+{
+   ata_driver_t *drv = ata_get_driver(channel, drive);
+   if (!drv) return;
+
+   drv->start_lba = 0; // We use absolute LBA
+   drv->partition_length = partition_size;
+
+   // Perform software reset
+   ata_soft_reset(drv->dcr_port, drv->tf_port);
+
+   ata_configure(drv);
+   ata_init_irq(drv->channel);
+}
+
+/**
+ * Read sectors using PIO mode (28-bit LBA). With READ MULTIPLE the drive
+ * raises DRQ once per block of drv->multiple sectors instead of once per
+ * sector.
+ */
+static int ata_pio_read(ata_driver_t *drv, uint32_t lba, uint8_t *buffer,
+                        uint32_t count)
+{
+   bool lba48 = ata_needs_lba48(lba, count);
+   if (lba48 && !drv->lba48) return -1;
+
+   uint32_t block = drv->multiple ? drv->multiple : 1;
+   uint8_t command = ata_command(drv, false, false, lba48);
+   if (ata_issue(drv, lba, count, command, lba48) != 0) return -1;
+
+   for (uint32_t sec = 0; sec < count; sec += block)
+   {
+      // Wait for data ready or error
       if (ata_wait_drq(drv->tf_port) != 0)
       {
          return -1;
       }
 
-      // Write 512 bytes (256 words) to data port using 16-bit writes
-      const uint8_t *src = buffer + (sec * 512);
-      const uint16_t *src_words = (const uint16_t *)src;
-      for (int i = 0; i < 256; i++)
-      {
-         // Write 16-bit word to data port
-         HAL_outw(drv->tf_port + ATA_REG_DATA, src_words[i]);
-      }
+      // The last block may be short
+      uint32_t n = count - sec < block ? count - sec : block;
+      HAL_insw(drv->tf_port + ATA_REG_DATA, buffer + sec * ATA_SECTOR_SIZE,
+               n * (ATA_SECTOR_SIZE / 2));
+   }
 
-      // For all sectors except the last, wait briefly before next sector
-      // For the last sector, wait for completion
-      if (sec < count - 1)
-      {
-         // Brief delay between sectors
-         for (volatile int i = 0; i < 10000; i++);
-      }
-      else
+   // Reading the data clears DRQ; let the drive settle before the next command
+   ata_delay_400ns(drv->dcr_port);
+   return 0;
+}
+
+/**
+ * Write sectors using PIO mode (28-bit LBA)
+ */
+static int ata_pio_write(ata_driver_t *drv, uint32_t lba, const uint8_t *buffer,
+                         uint32_t count)
+{
+   bool lba48 = ata_needs_lba48(lba, count);
+   if (lba48 && !drv->lba48) return -1;
+
+   uint32_t block = drv->multiple ? drv->multiple : 1;
+   uint8_t command = ata_command(drv, true, false, lba48);
+   if (ata_issue(drv, lba, count, command, lba48) != 0) return -1;
+
+   for (uint32_t sec = 0; sec < count; sec += block)
+   {
+      // Wait for drive ready to accept data
+      if (ata_wait_drq(drv->tf_port) != 0)
       {
-         // Last sector: wait for drive to finish
-         if (ata_wait_busy(drv->tf_port) != 0)
-         {
-            return -1;
-         }
+         return -1;
       }
+
+      uint32_t n = count - sec < block ? count - sec : block;
+      HAL_outsw(drv->tf_port + ATA_REG_DATA, buffer + sec * ATA_SECTOR_SIZE,
+                n * (ATA_SECTOR_SIZE / 2));
+      ata_delay_400ns(drv->dcr_port);
+   }
+
+   // Wait for the drive to commit the last block
+   if (ata_wait_busy(drv->tf_port) != 0)
+   {
+      return -1;
    }
 
    // Final status check to catch any errors
    uint8_t final_status = HAL_inb(drv->tf_port + ATA_REG_STATUS);
-   if (final_status & ATA_STATUS_ERR)
+   if (final_status & (ATA_STATUS_ERR | ATA_STATUS_DF))
    {
-      uint8_t error = HAL_inb(drv->tf_port + ATA_REG_ERROR);
       return -1;
    }
 
    return 0;
 }
 
+static void ata_sync_done(ATA_Request *req, int status)
+{
+   *(volatile int *)req->context = status;
+}
+
+/**
+ * Run a single-buffer request through ATA_Submit and halt until its
+ * completion interrupt. Returns 1 if the request could not be started.
+ */
+static int ata_sync_transfer(int channel, int drive, uint32_t lba,
+                             uint8_t *buffer, uint32_t count, bool write)
+{
+   volatile int status = 1;
+   ATA_Request req = {.channel = channel,
+                      .drive = drive,
+                      .lba = lba,
+                      .write = write,
+                      .segment_count = 1,
+                      .done = ata_sync_done,
+                      .context = (void *)&status};
+   req.segments[0].buffer = buffer;
+   req.segments[0].count = count;
+
+   if (ATA_Submit(&req) != 0) return 1;
+
+   // Check and halt with interrupts off so the completion can't slip in
+   // between the two
+   uint32_t flags = HAL_SaveInterrupts();
+   for (int wakeups = 0; status == 1 && wakeups < ATA_IRQ_TIMEOUT_WAKEUPS;
+        wakeups++)
+   {
+      HAL_WaitForInterrupt();
+   }
+   HAL_RestoreInterrupts(flags);
+
+   if (status == 1)
+   {
+      printf("[ata] request timeout at LBA %u\n", lba);
+      ATA_Abort(channel);
+   }
+   return status;
+}
+
+/**
+ * Read sectors from ATA drive. Long transfers are split into commands of at
+ * most ATA_MAX_COMMAND_SECTORS. Each command is interrupt driven (DMA when
+ * available); if it can't be started or fails, it is retried with polled
+ * PIO.
+ */
+int ATA_Read(int channel, int drive, uint32_t lba, uint8_t *buffer,
+             uint32_t count)
+{
+   ata_driver_t *drv = ata_get_driver(channel, drive);
+   if (!drv || !buffer || count == 0) return -1;
+
+   while (count > 0)
+   {
+      uint32_t n =
+          count > ATA_MAX_COMMAND_SECTORS ? ATA_MAX_COMMAND_SECTORS : count;
+
+      if (ata_sync_transfer(channel, drive, lba, buffer, n, false) != 0)
+      {
+         if (ata_channels[drv->channel].active) return -1; // Busy (async I/O)
+         if (ata_pio_read(drv, lba, buffer, n) != 0) return -1;
+      }
+
+      lba += n;
+      buffer += n * ATA_SECTOR_SIZE;
+      count -= n;
+   }
+   return 0;
+}
+
+/**
+ * Write sectors to ATA drive, split like ATA_Read, interrupt driven with a
+ * polled PIO fallback
+ */
+int ATA_Write(int channel, int drive, uint32_t lba, const uint8_t *buffer,
+              uint32_t count)
+{
+   ata_driver_t *drv = ata_get_driver(channel, drive);
+   if (!drv || !buffer || count == 0) return -1;
+
+   while (count > 0)
+   {
+      uint32_t n =
+          count > ATA_MAX_COMMAND_SECTORS ? ATA_MAX_COMMAND_SECTORS : count;
+
+      if (ata_sync_transfer(channel, drive, lba, (uint8_t *)buffer, n, true) !=
+          0)
+      {
+         if (ata_channels[drv->channel].active) return -1; // Busy (async I/O)
+         if (ata_pio_write(drv, lba, buffer, n) != 0) return -1;
+      }
+
+      lba += n;
+      buffer += n * ATA_SECTOR_SIZE;
+      count -= n;
+   }
+   return 0;
+}
+
+void ATA_SetPolled(int channel, bool polled)
+{
+   if (channel < 0 || channel > 1) return;
+   ata_channels[channel].polled = polled;
+}
+
+void ATA_Abort(int channel)
+{
+   if (channel < 0 || channel > 1) return;
+   ata_channel_t *ch = &ata_channels[channel];
+
+   // Detach the request first so a late interrupt finds the channel idle
+   uint32_t flags = HAL_SaveInterrupts();
+   ATA_Request *req = ch->active;
+   if (req && ch->active_dma) HAL_outb(ch->bmide + ATA_BM_COMMAND, 0);
+   ch->active = NULL;
+   ch->active_drv = NULL;
+   HAL_RestoreInterrupts(flags);
+
+   // Reset before failing the request: its callback may start the next one
+   ATA_Reset(channel);
+   if (req && req->done) req->done(req, -1);
+}
+
 /**
  * Perform software reset on ATA channel
  */
 void ATA_Reset(int channel)
 {
    uint16_t dcr_port = (channel == 0) ? 0x3F6 : 0x376;
-   ata_soft_reset(dcr_port);
+   uint16_t tf_port = (channel == 0) ? 0x1F0 : 0x170;
+   ata_soft_reset(dcr_port, tf_port);
+
+   // The multiple-block setting may not survive a reset; program it again
+   for (int drive = 0; drive < 2; drive++)
+   {
+      ata_driver_t *drv = ata_get_driver(channel, drive);
+      if (drv && (drv->multiple || drv->dma)) ata_configure(drv);
+   }
 }
@@ -2,6 +2,7 @@
 
 #ifndef ATA_H
 #define ATA_H
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -15,6 +16,44 @@
 #define ATA_DRIVE_MASTER 0
 #define ATA_DRIVE_SLAVE 1
 
+// Longest single command. LBA48 allows more, but this is what the DMA bounce
+// buffer holds; ATA_Read/ATA_Write split longer transfers.
+#define ATA_MAX_COMMAND_SECTORS 256
+
+// Scatter list entries per asynchronous request
+#define ATA_MAX_SEGMENTS 16
+
+typedef struct ATA_Request ATA_Request;
+
+/**
+ * Completion callback, run from the channel's IRQ handler (or from
+ * ATA_Abort). status is 0 on success, -1 on failure.
+ */
+typedef void (*ATA_Callback)(ATA_Request *req, int status);
+
+/**
+ * Asynchronous transfer of consecutive sectors starting at lba. The data is
+ * scattered over segments in order; the segment sector counts add up to the
+ * request length (at most ATA_MAX_COMMAND_SECTORS). Sectors at or beyond
+ * 2^28 (128 GiB) are reached with the LBA48 command set. The request must stay valid until
+ * its callback has run.
+ */
+struct ATA_Request
+{
+   int channel;
+   int drive;
+   uint32_t lba;
+   bool write;
+   uint32_t segment_count;
+   struct
+   {
+      uint8_t *buffer;
+      uint32_t count;
+   } segments[ATA_MAX_SEGMENTS];
+   ATA_Callback done;
+   void *context;
+};
+
 /**
  * Initialize ATA driver for a specific drive
  * @param channel - IDE channel (ATA_CHANNEL_PRIMARY or ATA_CHANNEL_SECONDARY)
@@ -31,7 +70,8 @@ void ATA_Init(int channel, int drive, uint32_t partition_start,
  * @param drive - Drive on channel (ATA_DRIVE_MASTER or ATA_DRIVE_SLAVE)
  * @param lba - Logical block address (relative to partition start)
  * @param buffer - Destination buffer (must be at least count*512 bytes)
- * @param count - Number of sectors to read
+ * @param count - Number of sectors to read (split into several commands as
+ *                needed)
  * @return 0 on success, -1 on failure
  */
 int ATA_Read(int channel, int drive, uint32_t lba, uint8_t *buffer,
@@ -43,12 +83,33 @@ int ATA_Read(int channel, int drive, uint32_t lba, uint8_t *buffer,
  * @param drive - Drive on channel (ATA_DRIVE_MASTER or ATA_DRIVE_SLAVE)
  * @param lba - Logical block address (relative to partition start)
  * @param buffer - Source buffer
- * @param count - Number of sectors to write
+ * @param count - Number of sectors to write (split as needed)
  * @return 0 on success, -1 on failure
  */
 int ATA_Write(int channel, int drive, uint32_t lba, const uint8_t *buffer,
               uint32_t count);
 
+/**
+ * Start an asynchronous request. Each channel runs one command at a time;
+ * queueing is left to the caller (see DISK_Submit). On a polled channel the
+ * command runs to completion, callback included, before this returns.
+ * @return 0 if the command was started, -1 if the request is invalid, the
+ *         channel is busy or the drive rejected the command
+ */
+int ATA_Submit(ATA_Request *req);
+
+/**
+ * Switch a channel between interrupt-driven and polled PIO commands. Used
+ * when completion interrupts turn out to be lost or misrouted.
+ */
+void ATA_SetPolled(int channel, bool polled);
+
+/**
+ * Fail the channel's in-flight request (if any) and reset the channel.
+ * Used by waiters that time out on a lost interrupt.
+ */
+void ATA_Abort(int channel);
+
 /**
  * Perform software reset on ATA channel
  * @param channel - IDE channel (ATA_CHANNEL_PRIMARY or ATA_CHANNEL_SECONDARY)
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "pci.h"
+#include <hal/io.h>
+#include <stddef.h>
+
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+
+static void pci_select(PCI_Address addr, uint8_t offset)
+{
+   uint32_t address = 0x80000000u | ((uint32_t)addr.bus << 16) |
+                      ((uint32_t)(addr.device & 0x1F) << 11) |
+                      ((uint32_t)(addr.function & 0x07) << 8) |
+                      (offset & 0xFC);
+   HAL_outl(PCI_CONFIG_ADDRESS, address);
+}
+
+uint32_t PCI_ConfigRead32(PCI_Address addr, uint8_t offset)
+{
+   pci_select(addr, offset);
+   return HAL_inl(PCI_CONFIG_DATA);
+}
+
+uint16_t PCI_ConfigRead16(PCI_Address addr, uint8_t offset)
+{
+   pci_select(addr, offset);
+   return HAL_inw(PCI_CONFIG_DATA + (offset & 2));
+}
+
+void PCI_ConfigWrite32(PCI_Address addr, uint8_t offset, uint32_t value)
+{
+   pci_select(addr, offset);
+   HAL_outl(PCI_CONFIG_DATA, value);
+}
+
+void PCI_ConfigWrite16(PCI_Address addr, uint8_t offset, uint16_t value)
+{
+   pci_select(addr, offset);
+   HAL_outw(PCI_CONFIG_DATA + (offset & 2), value);
+}
+
+bool PCI_FindClass(uint8_t class_code, uint8_t subclass, PCI_Address *out)
+{
+   for (uint32_t bus = 0; bus < 256; bus++)
+   {
+      for (uint8_t device = 0; device < 32; device++)
+      {
+         PCI_Address addr = {(uint8_t)bus, device, 0};
+         if (PCI_ConfigRead16(addr, PCI_REG_VENDOR_ID) == 0xFFFF) continue;
+
+         // Only probe functions 1-7 on multi-function devices
+         uint8_t header = PCI_ConfigRead32(addr, PCI_REG_HEADER_TYPE) >> 16;
+         uint8_t functions = (header & 0x80) ? 8 : 1;
+
+         for (uint8_t function = 0; function < functions; function++)
+         {
+            addr.function = function;
+            if (PCI_ConfigRead16(addr, PCI_REG_VENDOR_ID) == 0xFFFF) continue;
+
+            uint32_t class_reg = PCI_ConfigRead32(addr, PCI_REG_CLASS);
+            if ((class_reg >> 24) == class_code &&
+                ((class_reg >> 16) & 0xFF) == subclass)
+            {
+               if (out) *out = addr;
+               return true;
+            }
+         }
+      }
+   }
+   return false;
+}
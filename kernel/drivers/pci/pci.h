@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef PCI_H
+#define PCI_H
+#include <stdbool.h>
+#include <stdint.h>
+
+// Standard configuration space offsets
+#define PCI_REG_VENDOR_ID 0x00
+#define PCI_REG_COMMAND 0x04
+#define PCI_REG_CLASS 0x08 // Revision, prog IF, subclass, class
+#define PCI_REG_HEADER_TYPE 0x0E
+#define PCI_REG_BAR0 0x10
+#define PCI_REG_BAR4 0x20
+
+// Command register bits
+#define PCI_COMMAND_IO 0x0001
+#define PCI_COMMAND_MEMORY 0x0002
+#define PCI_COMMAND_BUS_MASTER 0x0004
+
+// Class codes
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+
+typedef struct
+{
+   uint8_t bus;
+   uint8_t device;
+   uint8_t function;
+} PCI_Address;
+
+// Configuration mechanism #1 accessors; offset is rounded down to the
+// access size
+uint32_t PCI_ConfigRead32(PCI_Address addr, uint8_t offset);
+uint16_t PCI_ConfigRead16(PCI_Address addr, uint8_t offset);
+void PCI_ConfigWrite32(PCI_Address addr, uint8_t offset, uint32_t value);
+void PCI_ConfigWrite16(PCI_Address addr, uint8_t offset, uint16_t value);
+
+// Find the first function with the given class and subclass.
+// Returns true and fills out on success.
+bool PCI_FindClass(uint8_t class_code, uint8_t subclass, PCI_Address *out);
+
+#endif
@@ -0,0 +1,349 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "bcache.h"
+#include <mem/heap.h>
+#include <mem/memory.h>
+#include <std/stdio.h>
+#include <stddef.h>
+
+#define BCACHE_BLOCK_SIZE 512
+
+typedef struct BCache_Block
+{
+   DISK *disk;
+   uint32_t lba;
+   bool valid;
+   bool dirty;
+   uint8_t *data;
+   struct BCache_Block *hash_next;
+   struct BCache_Block *lru_prev; /* Towards most recently used */
+   struct BCache_Block *lru_next; /* Towards least recently used */
+   DISK_Request writeback;
+} BCache_Block;
+
+static BCache_Block *g_Blocks;
+static uint8_t *g_BlockData;
+static BCache_Block **g_Buckets;
+static uint32_t g_BucketMask;
+static BCache_Block *g_LruHead; /* Most recently used */
+static BCache_Block *g_LruTail; /* Next victim */
+
+/* Transfers longer than this skip the cache, so one large sequential read
+ * or write does not flush the working set of metadata blocks.
+ */
+static uint32_t g_BypassSectors;
+
+/* Staging buffer for BCache_Prefetch: runs are read contiguously and then
+ * copied into their (scattered) blocks */
+static uint8_t *g_PrefetchBuffer;
+static uint32_t g_PrefetchSectors;
+
+static BCache_Stats g_Stats;
+
+static inline uint32_t bcache_hash(DISK *disk, uint32_t lba)
+{
+   uint32_t h = lba ^ ((uint32_t)(uintptr_t)disk >> 4);
+   return (h * 2654435761u) & g_BucketMask;
+}
+
+static BCache_Block *bcache_lookup(DISK *disk, uint32_t lba)
+{
+   for (BCache_Block *b = g_Buckets[bcache_hash(disk, lba)]; b;
+        b = b->hash_next)
+   {
+      if (b->lba == lba && b->disk == disk) return b;
+   }
+   return NULL;
+}
+
+static void bcache_hash_remove(BCache_Block *block)
+{
+   BCache_Block **link = &g_Buckets[bcache_hash(block->disk, block->lba)];
+   while (*link != block) link = &(*link)->hash_next;
+   *link = block->hash_next;
+   block->hash_next = NULL;
+}
+
+static void bcache_lru_unlink(BCache_Block *block)
+{
+   if (block->lru_prev)
+      block->lru_prev->lru_next = block->lru_next;
+   else
+      g_LruHead = block->lru_next;
+   if (block->lru_next)
+      block->lru_next->lru_prev = block->lru_prev;
+   else
+      g_LruTail = block->lru_prev;
+   block->lru_prev = block->lru_next = NULL;
+}
+
+static void bcache_touch(BCache_Block *block)
+{
+   if (g_LruHead == block) return;
+   bcache_lru_unlink(block);
+   block->lru_next = g_LruHead;
+   if (g_LruHead) g_LruHead->lru_prev = block;
+   g_LruHead = block;
+   if (!g_LruTail) g_LruTail = block;
+}
+
+/* Recycle the least recently used block for (disk, lba). A dirty victim
+ * triggers a full sync rather than a lone write, so the elevator can merge
+ * it with its neighbours.
+ */
+static BCache_Block *bcache_insert(DISK *disk, uint32_t lba)
+{
+   BCache_Block *block = g_LruTail;
+
+   if (block->dirty && (!BCache_Sync() || block->dirty)) return NULL;
+   if (block->valid)
+   {
+      bcache_hash_remove(block);
+      g_Stats.evictions++;
+      g_Stats.cached--;
+   }
+
+   block->disk = disk;
+   block->lba = lba;
+   block->valid = true;
+   block->dirty = false;
+   uint32_t bucket = bcache_hash(disk, lba);
+   block->hash_next = g_Buckets[bucket];
+   g_Buckets[bucket] = block;
+   g_Stats.cached++;
+
+   bcache_touch(block);
+   return block;
+}
+
+static void bcache_release(void)
+{
+   free(g_Blocks);
+   free(g_BlockData);
+   free(g_Buckets);
+   free(g_PrefetchBuffer);
+   g_Blocks = NULL;
+   g_BlockData = NULL;
+   g_Buckets = NULL;
+   g_PrefetchBuffer = NULL;
+   g_LruHead = g_LruTail = NULL;
+}
+
+bool BCache_Initialize(uint32_t blocks)
+{
+   if (g_Blocks && !BCache_Sync()) return false;
+   bcache_release();
+   memset(&g_Stats, 0, sizeof(g_Stats));
+   if (blocks == 0) return true;
+
+   // Power-of-two bucket count, about two blocks per bucket
+   uint32_t buckets = 1;
+   while (buckets * 2 < blocks) buckets <<= 1;
+
+   g_Blocks = kzalloc(blocks * sizeof(BCache_Block));
+   g_BlockData = kmalloc(blocks * BCACHE_BLOCK_SIZE);
+   g_Buckets = kzalloc(buckets * sizeof(BCache_Block *));
+   if (!g_Blocks || !g_BlockData || !g_Buckets)
+   {
+      printf("[bcache] failed to allocate %u blocks\n", blocks);
+      bcache_release();
+      return false;
+   }
+
+   g_BucketMask = buckets - 1;
+   g_BypassSectors = blocks / 4;
+
+   // Read-ahead never takes more than a quarter of the cache either
+   g_PrefetchSectors = g_BypassSectors < BCACHE_PREFETCH_MAX
+                           ? g_BypassSectors
+                           : BCACHE_PREFETCH_MAX;
+   if (g_PrefetchSectors > 0)
+      g_PrefetchBuffer = kmalloc(g_PrefetchSectors * BCACHE_BLOCK_SIZE);
+   if (!g_PrefetchBuffer) g_PrefetchSectors = 0;
+   g_Stats.blocks = blocks;
+
+   for (uint32_t i = 0; i < blocks; i++)
+   {
+      BCache_Block *block = &g_Blocks[i];
+      block->data = g_BlockData + i * BCACHE_BLOCK_SIZE;
+      block->lru_prev = i > 0 ? &g_Blocks[i - 1] : NULL;
+      block->lru_next = i + 1 < blocks ? &g_Blocks[i + 1] : NULL;
+   }
+   g_LruHead = &g_Blocks[0];
+   g_LruTail = &g_Blocks[blocks - 1];
+
+   printf("[bcache] %u blocks (%u KiB), %u buckets\n", blocks,
+          blocks * BCACHE_BLOCK_SIZE / 1024, buckets);
+   return true;
+}
+
+bool BCache_Read(DISK *disk, uint32_t lba, uint32_t sectors, void *dataOut)
+{
+   if (!g_Blocks) return DISK_ReadSectors(disk, lba, sectors, dataOut);
+
+   uint8_t *out = dataOut;
+   uint32_t i = 0;
+   while (i < sectors)
+   {
+      BCache_Block *block = bcache_lookup(disk, lba + i);
+      if (block)
+      {
+         memcpy(out + i * BCACHE_BLOCK_SIZE, block->data, BCACHE_BLOCK_SIZE);
+         bcache_touch(block);
+         g_Stats.hits++;
+         i++;
+         continue;
+      }
+
+      // Read the whole run of missing sectors with one request
+      uint32_t run = 1;
+      while (i + run < sectors && !bcache_lookup(disk, lba + i + run)) run++;
+      g_Stats.misses += run;
+
+      uint8_t *dst = out + i * BCACHE_BLOCK_SIZE;
+      if (!DISK_ReadSectors(disk, lba + i, run, dst)) return false;
+
+      if (run <= g_BypassSectors)
+      {
+         for (uint32_t j = 0; j < run; j++)
+         {
+            block = bcache_insert(disk, lba + i + j);
+            if (!block) break;
+            memcpy(block->data, dst + j * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+         }
+      }
+      i += run;
+   }
+   return true;
+}
+
+bool BCache_Write(DISK *disk, uint32_t lba, uint32_t sectors,
+                  const void *dataIn)
+{
+   if (!g_Blocks) return DISK_WriteSectors(disk, lba, sectors, dataIn);
+
+   const uint8_t *in = dataIn;
+
+   if (sectors > g_BypassSectors)
+   {
+      // Write through, then refresh any cached copies
+      if (!DISK_WriteSectors(disk, lba, sectors, dataIn)) return false;
+      for (uint32_t i = 0; i < sectors; i++)
+      {
+         BCache_Block *block = bcache_lookup(disk, lba + i);
+         if (!block) continue;
+         memcpy(block->data, in + i * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+         if (block->dirty)
+         {
+            block->dirty = false;
+            g_Stats.dirty--;
+         }
+      }
+      return true;
+   }
+
+   for (uint32_t i = 0; i < sectors; i++)
+   {
+      BCache_Block *block = bcache_lookup(disk, lba + i);
+      if (block)
+         bcache_touch(block);
+      else if (!(block = bcache_insert(disk, lba + i)))
+         return false;
+
+      memcpy(block->data, in + i * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+      if (!block->dirty)
+      {
+         block->dirty = true;
+         g_Stats.dirty++;
+      }
+   }
+   return true;
+}
+
+bool BCache_Prefetch(DISK *disk, uint32_t lba, uint32_t sectors)
+{
+   if (!g_Blocks || g_PrefetchSectors == 0) return true;
+   if (sectors > g_PrefetchSectors) sectors = g_PrefetchSectors;
+
+   uint32_t i = 0;
+   while (i < sectors)
+   {
+      if (bcache_lookup(disk, lba + i))
+      {
+         i++;
+         continue;
+      }
+
+      uint32_t run = 1;
+      while (i + run < sectors && !bcache_lookup(disk, lba + i + run)) run++;
+
+      if (!DISK_ReadSectors(disk, lba + i, run, g_PrefetchBuffer)) return false;
+      for (uint32_t j = 0; j < run; j++)
+      {
+         BCache_Block *block = bcache_insert(disk, lba + i + j);
+         if (!block) return false;
+         memcpy(block->data, g_PrefetchBuffer + j * BCACHE_BLOCK_SIZE,
+                BCACHE_BLOCK_SIZE);
+      }
+      g_Stats.prefetched += run;
+      i += run;
+   }
+   return true;
+}
+
+bool BCache_Sync(void)
+{
+   if (!g_Blocks || g_Stats.dirty == 0) return true;
+
+   // Queue every dirty block at once; the disk queue sorts and merges
+   // adjacent ones into multi-sector commands
+   for (uint32_t i = 0; i < g_Stats.blocks; i++)
+   {
+      BCache_Block *block = &g_Blocks[i];
+      if (!block->dirty) continue;
+
+      block->writeback = (DISK_Request){.disk = block->disk,
+                                        .lba = block->lba,
+                                        .sectors = 1,
+                                        .buffer = block->data,
+                                        .write = true};
+      if (!DISK_Submit(&block->writeback))
+         block->writeback.status = DISK_REQUEST_ERROR;
+   }
+
+   bool ok = true;
+   for (uint32_t i = 0; i < g_Stats.blocks; i++)
+   {
+      BCache_Block *block = &g_Blocks[i];
+      if (!block->dirty) continue;
+
+      if (!DISK_WaitRequest(&block->writeback))
+      {
+         ok = false;
+         continue;
+      }
+      block->dirty = false;
+      g_Stats.dirty--;
+      g_Stats.writebacks++;
+   }
+
+   if (!ok) printf("[bcache] sync: write-back failed\n");
+   return ok;
+}
+
+void BCache_GetStats(BCache_Stats *out)
+{
+   if (out) *out = g_Stats;
+}
+
+void BCache_PrintStats(void)
+{
+   uint32_t lookups = g_Stats.hits + g_Stats.misses;
+   printf("[bcache] %u/%u blocks cached, %u dirty\n", g_Stats.cached,
+          g_Stats.blocks, g_Stats.dirty);
+   printf("[bcache] hits %u misses %u (%u%% hit), prefetched %u, evictions %u, "
+          "writebacks %u\n",
+          g_Stats.hits, g_Stats.misses,
+          lookups ? g_Stats.hits * 100 / lookups : 0, g_Stats.prefetched,
+          g_Stats.evictions, g_Stats.writebacks);
+}
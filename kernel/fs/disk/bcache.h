@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "disk.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Sector (512 byte) block cache between the partition layer and the disk
+ * driver. Blocks are found through a hash of (disk, lba) and recycled in
+ * LRU order. Writes are held in the cache (write-back) until BCache_Sync()
+ * or until a dirty block is evicted.
+ */
+
+/* Cache size used by FS_Initialize (blocks of 512 bytes) */
+#define BCACHE_DEFAULT_BLOCKS 1024
+
+typedef struct
+{
+   uint32_t blocks;     /* Capacity in blocks */
+   uint32_t cached;     /* Blocks holding valid data */
+   uint32_t dirty;      /* Blocks waiting for write-back */
+   uint32_t hits;       /* Sectors served from the cache */
+   uint32_t misses;     /* Sectors read from disk */
+   uint32_t evictions;  /* Valid blocks recycled */
+   uint32_t writebacks; /* Dirty blocks written to disk */
+   uint32_t prefetched; /* Blocks loaded ahead of use by BCache_Prefetch */
+} BCache_Stats;
+
+/* (Re)size the cache. Any dirty blocks are flushed first. 0 disables the
+ * cache, making reads and writes go straight to the disk.
+ */
+bool BCache_Initialize(uint32_t blocks);
+
+bool BCache_Read(DISK *disk, uint32_t lba, uint32_t sectors, void *dataOut);
+bool BCache_Write(DISK *disk, uint32_t lba, uint32_t sectors,
+                  const void *dataIn);
+
+/* Load sectors into the cache ahead of use (read-ahead). Sectors already
+ * cached are skipped; each run of missing ones is read with one request.
+ * At most BCACHE_PREFETCH_MAX sectors are loaded per call. No-op when the
+ * cache is disabled.
+ */
+#define BCACHE_PREFETCH_MAX 256
+bool BCache_Prefetch(DISK *disk, uint32_t lba, uint32_t sectors);
+
+/* Write all dirty blocks to disk. Returns false if any write failed; those
+ * blocks stay dirty.
+ */
+bool BCache_Sync(void);
+
+void BCache_GetStats(BCache_Stats *out);
+void BCache_PrintStats(void);
+
+#endif
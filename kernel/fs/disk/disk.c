@@ -3,12 +3,252 @@
 #include "disk.h"
 #include <drivers/ata/ata.h>
 #include <drivers/fdc/fdc.h>
+#include <hal/io.h>
+#include <std/stdio.h>
+#include <stddef.h>
 #include <sys/sys.h>
 
 // Disk type constants
 #define DISK_TYPE_FLOPPY 0
 #define DISK_TYPE_ATA 1
 
+// Requests of a long transfer that are queued at once
+#define DISK_BATCH_REQUESTS 8
+
+// Interrupts (timer runs at 1 kHz) without progress before a request is
+// considered lost
+#define DISK_TIMEOUT_WAKEUPS 5000
+
+// Timeouts after which the ATA channel stays in polled mode for good
+#define DISK_POLLED_AFTER_TIMEOUTS 3
+
+/* Request queue for the ATA disk. Pending requests are kept sorted by LBA;
+ * the in-flight command may carry several merged requests.
+ */
+typedef struct
+{
+   DISK_Request *pending;   /* Sorted by LBA, FIFO among equal LBAs */
+   DISK_Request *inflight;  /* Requests merged into the running command */
+   ATA_Request command;     /* Command handed to the driver */
+   uint32_t head;           /* LBA after the last dispatched command */
+   uint32_t sequence;       /* Submission counter, for ordering hazards */
+   volatile uint32_t completions;
+   uint32_t timeouts;       /* Commands lost so far */
+   bool requeue;            /* Put the next failed command back in line */
+} DISK_Queue;
+
+static DISK_Queue g_AtaQueue;
+
+static void disk_finish(DISK_Request *req, bool ok)
+{
+   req->status = ok ? DISK_REQUEST_DONE : DISK_REQUEST_ERROR;
+   if (req->done) req->done(req);
+}
+
+static bool disk_overlaps(const DISK_Request *a, const DISK_Request *b)
+{
+   return a->lba < b->lba + b->sectors && b->lba < a->lba + a->sectors;
+}
+
+/* Oldest pending request submitted before req that must complete first:
+ * it overlaps req and one of the two writes. Reordering those would return
+ * stale data or lose a write. */
+static DISK_Request *disk_hazard(DISK_Queue *q, const DISK_Request *req)
+{
+   DISK_Request *oldest = NULL;
+   for (DISK_Request *it = q->pending; it; it = it->next)
+   {
+      if (it == req || it->sequence >= req->sequence) continue;
+      if (!(it->write || req->write) || !disk_overlaps(it, req)) continue;
+      if (!oldest || it->sequence < oldest->sequence) oldest = it;
+   }
+   return oldest;
+}
+
+static void disk_ata_done(ATA_Request *command, int status);
+
+/* Insert into the pending list, keeping it sorted by LBA */
+static void disk_enqueue(DISK_Queue *q, DISK_Request *req)
+{
+   DISK_Request **link = &q->pending;
+   while (*link && (*link)->lba <= req->lba) link = &(*link)->next;
+   req->next = *link;
+   *link = req;
+}
+
+/* Start the next command if the drive is idle. Called with interrupts
+ * disabled. */
+static void disk_dispatch(DISK_Queue *q)
+{
+   while (!q->inflight && q->pending)
+   {
+      // C-LOOK: continue upwards from the head, wrap to the lowest LBA
+      DISK_Request *first = q->pending;
+      for (DISK_Request *it = q->pending; it; it = it->next)
+      {
+         if (it->lba >= q->head)
+         {
+            first = it;
+            break;
+         }
+      }
+      for (DISK_Request *older; (older = disk_hazard(q, first));)
+         first = older;
+
+      // Merge the following requests while they continue the same transfer
+      DISK_Request *last = first;
+      uint32_t total = first->sectors;
+      uint32_t segments = 1;
+      while (last->next && segments < ATA_MAX_SEGMENTS)
+      {
+         DISK_Request *next = last->next;
+         if (next->write != first->write ||
+             next->lba != last->lba + last->sectors ||
+             total + next->sectors > DISK_MAX_REQUEST_SECTORS ||
+             disk_hazard(q, next))
+            break;
+         total += next->sectors;
+         segments++;
+         last = next;
+      }
+
+      // Detach first..last as the in-flight chain
+      DISK_Request *rest = last->next;
+      last->next = NULL;
+      DISK_Request **link = &q->pending;
+      while (*link != first) link = &(*link)->next;
+      *link = rest;
+
+      ATA_Request *cmd = &q->command;
+      cmd->channel = ATA_CHANNEL_PRIMARY;
+      cmd->drive = ATA_DRIVE_MASTER;
+      cmd->lba = first->lba;
+      cmd->write = first->write;
+      cmd->segment_count = 0;
+      for (DISK_Request *it = first; it; it = it->next)
+      {
+         cmd->segments[cmd->segment_count].buffer = it->buffer;
+         cmd->segments[cmd->segment_count].count = it->sectors;
+         cmd->segment_count++;
+      }
+      cmd->done = disk_ata_done;
+      cmd->context = q;
+
+      q->inflight = first;
+      q->head = first->lba + total;
+      if (ATA_Submit(cmd) != 0)
+      {
+         q->inflight = NULL;
+         while (first)
+         {
+            DISK_Request *next = first->next;
+            first->next = NULL;
+            disk_finish(first, false);
+            first = next;
+         }
+      }
+   }
+}
+
+/* Driver completion: retire the merged requests and start the next command */
+static void disk_ata_done(ATA_Request *command, int status)
+{
+   DISK_Queue *q = command->context;
+   DISK_Request *req = q->inflight;
+   q->inflight = NULL;
+   q->completions++;
+
+   // An aborted command is retried (polled, see DISK_WaitRequest); its
+   // requests keep their sequence numbers and so their ordering
+   bool retry = status != 0 && q->requeue;
+   q->requeue = false;
+
+   while (req)
+   {
+      DISK_Request *next = req->next;
+      req->next = NULL;
+      if (retry)
+         disk_enqueue(q, req);
+      else
+         disk_finish(req, status == 0);
+      req = next;
+   }
+
+   disk_dispatch(q);
+}
+
+bool DISK_Submit(DISK_Request *req)
+{
+   if (!req || !req->disk || !req->buffer || req->sectors == 0 ||
+       req->sectors > DISK_MAX_REQUEST_SECTORS)
+      return false;
+
+   req->status = DISK_REQUEST_PENDING;
+   req->next = NULL;
+
+   if (req->disk->type == DISK_TYPE_FLOPPY)
+   {
+      /* The FDC driver is polled: complete in place */
+      int rc = req->write ? FDC_WriteLba(req->lba, req->buffer, req->sectors)
+                          : FDC_ReadLba(req->lba, req->buffer, req->sectors);
+      disk_finish(req, rc == 0);
+      return true;
+   }
+   if (req->disk->type != DISK_TYPE_ATA) return false;
+
+   DISK_Queue *q = &g_AtaQueue;
+   uint32_t flags = HAL_SaveInterrupts();
+
+   req->sequence = q->sequence++;
+   disk_enqueue(q, req);
+
+   disk_dispatch(q);
+   HAL_RestoreInterrupts(flags);
+   return true;
+}
+
+bool DISK_WaitRequest(DISK_Request *req)
+{
+   uint32_t flags = HAL_SaveInterrupts();
+   uint32_t seen = g_AtaQueue.completions;
+   int wakeups = 0;
+
+   while (req->status == DISK_REQUEST_PENDING)
+   {
+      if (g_AtaQueue.completions != seen)
+      {
+         // The queue is moving; only a stalled command counts as a timeout
+         seen = g_AtaQueue.completions;
+         wakeups = 0;
+      }
+      if (wakeups++ >= DISK_TIMEOUT_WAKEUPS)
+      {
+         // The completion interrupt was lost: abort the command and run it
+         // again polled. After repeated losses the channel stays polled.
+         DISK_Queue *q = &g_AtaQueue;
+         bool stayPolled = ++q->timeouts >= DISK_POLLED_AFTER_TIMEOUTS;
+         printf("[disk] request at LBA %u timed out, retrying polled\n",
+                req->lba);
+         if (stayPolled && q->timeouts == DISK_POLLED_AFTER_TIMEOUTS)
+            printf("[disk] ATA completion interrupts unreliable, polling\n");
+
+         // Interrupts stay off: the completion path dispatches the queue
+         ATA_SetPolled(ATA_CHANNEL_PRIMARY, true);
+         q->requeue = true;
+         ATA_Abort(ATA_CHANNEL_PRIMARY); // Requeues and redispatches
+         q->requeue = false;
+         if (!stayPolled) ATA_SetPolled(ATA_CHANNEL_PRIMARY, false);
+         seen = g_AtaQueue.completions;
+         wakeups = 0;
+         continue;
+      }
+      HAL_WaitForInterrupt();
+   }
+
+   HAL_RestoreInterrupts(flags);
+   return req->status == DISK_REQUEST_DONE;
+}
+
 bool DISK_Initialize(DISK *disk, uint8_t driveNumber)
 {
    uint8_t driveType;
@@ -81,7 +321,47 @@ void DISK_LBA2CHS(DISK *disk, uint32_t lba, uint16_t *cylinderOut,
    *headOut = (lba / disk->sectors) % disk->heads;
 }
 
-bool DISK_ReadSectors(DISK *disk, uint32_t lba, uint8_t sectors, void *dataOut)
+/* Split an ATA transfer into DISK_MAX_REQUEST_SECTORS requests and queue
+ * them in batches, so the elevator sees the whole batch at once.
+ */
+static bool disk_ata_transfer(DISK *disk, uint32_t lba, uint32_t sectors,
+                              uint8_t *buffer, bool write)
+{
+   DISK_Request reqs[DISK_BATCH_REQUESTS];
+   bool ok = true;
+
+   while (sectors > 0 && ok)
+   {
+      uint32_t queued = 0;
+      while (queued < DISK_BATCH_REQUESTS && sectors > 0)
+      {
+         uint32_t count = sectors > DISK_MAX_REQUEST_SECTORS
+                              ? DISK_MAX_REQUEST_SECTORS
+                              : sectors;
+         reqs[queued] = (DISK_Request){.disk = disk,
+                                       .lba = lba,
+                                       .sectors = count,
+                                       .buffer = buffer,
+                                       .write = write};
+         if (!DISK_Submit(&reqs[queued]))
+         {
+            ok = false;
+            break;
+         }
+         queued++;
+         lba += count;
+         buffer += count * 512;
+         sectors -= count;
+      }
+
+      // Every queued request must be waited for; the array is on our stack
+      for (uint32_t i = 0; i < queued; i++)
+         if (!DISK_WaitRequest(&reqs[i])) ok = false;
+   }
+   return ok;
+}
+
+bool DISK_ReadSectors(DISK *disk, uint32_t lba, uint32_t sectors, void *dataOut)
 {
    if (sectors == 0) return false;
 
@@ -97,19 +377,16 @@ bool DISK_ReadSectors(DISK *disk, uint32_t lba, uint8_t sectors, void *dataOut)
    }
    else if (disk->type == DISK_TYPE_ATA)
    {
-      /* Hard disk (ATA): use the kernel ATA driver with primary master
-       * channel/drive.
+      /* Hard disk (ATA): queue the requests and wait for their completion
+       * interrupts.
        */
-      int rc = ATA_Read(ATA_CHANNEL_PRIMARY, ATA_DRIVE_MASTER, lba,
-                        (uint8_t *)dataOut, sectors);
-      if (rc != 0) return false;
-      return true;
+      return disk_ata_transfer(disk, lba, sectors, dataOut, false);
    }
 
    return false;
 }
 
-bool DISK_WriteSectors(DISK *disk, uint32_t lba, uint8_t sectors,
+bool DISK_WriteSectors(DISK *disk, uint32_t lba, uint32_t sectors,
                        const void *dataIn)
 {
    if (sectors == 0) return false;
@@ -125,13 +402,10 @@ bool DISK_WriteSectors(DISK *disk, uint32_t lba, uint8_t sectors,
    }
    else if (disk->type == DISK_TYPE_ATA)
    {
-      /* Hard disk (ATA): use the kernel ATA driver with primary master
-       * channel/drive.
+      /* Hard disk (ATA): queue the requests and wait for their completion
+       * interrupts.
        */
-      int rc = ATA_Write(ATA_CHANNEL_PRIMARY, ATA_DRIVE_MASTER, lba,
-                         (const uint8_t *)dataIn, sectors);
-      if (rc != 0) return false;
-      return true;
+      return disk_ata_transfer(disk, lba, sectors, (uint8_t *)dataIn, true);
    }
 
    return false;
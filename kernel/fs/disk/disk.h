@@ -28,10 +28,51 @@ typedef struct
    char device_name[32];   /* Device name (e.g., /dev/sda) */
 } __attribute__((packed)) DISK_Info;
 
+/* Asynchronous block requests. A request is at most one device command
+ * long; DISK_ReadSectors/DISK_WriteSectors split longer transfers. */
+#define DISK_MAX_REQUEST_SECTORS 256
+
+#define DISK_REQUEST_PENDING 0
+#define DISK_REQUEST_DONE 1
+#define DISK_REQUEST_ERROR 2
+
+typedef struct DISK_Request DISK_Request;
+
+/* Completion callback; runs in interrupt context and may submit further
+ * requests. */
+typedef void (*DISK_RequestCallback)(DISK_Request *req);
+
+struct DISK_Request
+{
+   DISK *disk;
+   uint32_t lba;               /* Absolute sector address */
+   uint32_t sectors;           /* 1..DISK_MAX_REQUEST_SECTORS */
+   void *buffer;               /* sectors * 512 bytes */
+   bool write;
+   DISK_RequestCallback done;  /* Optional */
+   void *context;              /* For the callback */
+   volatile int status;        /* DISK_REQUEST_* */
+
+   /* Owned by the request queue */
+   DISK_Request *next;
+   uint32_t sequence;
+};
+
 bool DISK_Initialize(DISK *disk, uint8_t driveNumber);
-bool DISK_ReadSectors(DISK *disk, uint32_t lba, uint8_t sectors,
+
+/* Queue a request and return immediately. ATA requests are sorted by LBA
+ * (C-LOOK elevator) and adjacent ones are merged into a single command.
+ * Floppy requests complete before DISK_Submit returns. Returns false if the
+ * request is invalid.
+ */
+bool DISK_Submit(DISK_Request *req);
+
+/* Halt until a submitted request completes; true if it succeeded */
+bool DISK_WaitRequest(DISK_Request *req);
+
+bool DISK_ReadSectors(DISK *disk, uint32_t lba, uint32_t sectors,
                       void *lowerDataOut);
-bool DISK_WriteSectors(DISK *disk, uint32_t lba, uint8_t sectors,
+bool DISK_WriteSectors(DISK *disk, uint32_t lba, uint32_t sectors,
                        const void *dataIn);
 
 #endif
\ No newline at end of file
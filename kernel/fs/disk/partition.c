@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
 #include "partition.h"
+#include "bcache.h"
 #include <mem/memory.h>
 
 typedef struct
@@ -42,16 +43,21 @@ void MBR_DetectPartition(Partition *part, DISK *disk, void *partition)
    }
 }
 
-bool Partition_ReadSectors(Partition *part, uint32_t lba, uint8_t sectors,
+bool Partition_ReadSectors(Partition *part, uint32_t lba, uint32_t sectors,
                            void *lowerDataOut)
 {
-   return DISK_ReadSectors(part->disk, lba + part->partitionOffset, sectors,
-                           lowerDataOut);
+   return BCache_Read(part->disk, lba + part->partitionOffset, sectors,
+                      lowerDataOut);
 }
 
-bool Partition_WriteSectors(Partition *part, uint32_t lba, uint8_t sectors,
+bool Partition_WriteSectors(Partition *part, uint32_t lba, uint32_t sectors,
                             const void *lowerDataIn)
 {
-   return DISK_WriteSectors(part->disk, lba + part->partitionOffset, sectors,
-                            lowerDataIn);
+   return BCache_Write(part->disk, lba + part->partitionOffset, sectors,
+                       lowerDataIn);
+}
+
+bool Partition_PrefetchSectors(Partition *part, uint32_t lba, uint32_t sectors)
+{
+   return BCache_Prefetch(part->disk, lba + part->partitionOffset, sectors);
 }
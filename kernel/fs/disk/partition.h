@@ -16,10 +16,17 @@ typedef struct
 
 void MBR_DetectPartition(Partition *part, DISK *disk, void *partition);
 
-bool Partition_ReadSectors(Partition *disk, uint32_t lba, uint8_t sectors,
+/* Sector counts are not limited to one device command; the disk layer
+ * splits long transfers. Both go through the block cache (bcache.h), so
+ * writes reach the disk on BCache_Sync(). */
+bool Partition_ReadSectors(Partition *disk, uint32_t lba, uint32_t sectors,
                            void *lowDataOut);
 
-bool Partition_WriteSectors(Partition *part, uint32_t lba, uint8_t sectors,
+bool Partition_WriteSectors(Partition *part, uint32_t lba, uint32_t sectors,
                             const void *lowerDataIn);
 
+/* Read-ahead hint: load sectors into the block cache without copying them
+ * anywhere. */
+bool Partition_PrefetchSectors(Partition *part, uint32_t lba, uint32_t sectors);
+
 #endif
\ No newline at end of file
@@ -3,21 +3,61 @@
 #include "fat.h"
 #include <drivers/ata/ata.h>
 #include <drivers/fdc/fdc.h>
+#include <fs/disk/bcache.h>
 #include <fs/disk/partition.h>
+#include <mem/heap.h>
 #include <mem/memdefs.h>
 #include <mem/memory.h>
 #include <std/ctype.h>
 #include <std/minmax.h>
 #include <std/stdio.h>
 #include <std/string.h>
+#include <std/trace.h>
 #include <stddef.h>
 
 #define SECTOR_SIZE 512
 #define MAX_PATH_SIZE 256
-#define MAX_FILE_HANDLES 10
 #define ROOT_DIRECTORY_HANDLE -1
 #define FAT_CACHE_SIZE 5
 
+// Upper bound on the read-ahead window of a sequentially read file, in
+// sectors (the window itself is tracked in clusters)
+#define FAT_READAHEAD_MAX_SECTORS 256
+
+// Upper bound on how far a streaming writer's chain is grown ahead of its
+// data in one step, in sectors (the step itself is tracked in clusters)
+#define FAT_PREALLOC_MAX_SECTORS 256
+
+// Runs of physically contiguous clusters remembered per open file
+#define FAT_MAX_EXTENTS 32
+
+// FAT_MOUNT_TABLE keeps the FAT in memory only if the table and its bitmaps
+// fit in this fraction of the largest free heap run; bigger volumes fall back
+// to the sector window cache
+#define FAT_TABLE_HEAP_SHARE 4
+
+// FAT sectors changed without the in-memory table that are held back and
+// written to every FAT copy in one pass by FAT_FlushFat
+#define FAT_DIRTY_SECTORS 16
+
+// Clusters per free-count summary group of the free-cluster bitmap
+#define FAT_GROUP_CLUSTERS 1024
+
+// FSInfo signatures and the "not known" value of its hint fields
+#define FAT_FSINFO_LEAD_SIGNATURE 0x41615252
+#define FAT_FSINFO_STRUCT_SIGNATURE 0x61417272
+#define FAT_FSINFO_TRAIL_SIGNATURE 0xAA550000
+#define FAT_FREE_UNKNOWN 0xFFFFFFFF
+
+// Open-file table: initial number of handle slots (the table doubles when
+// full) and hash buckets for the shared per-file nodes
+#define FAT_INITIAL_HANDLES 16
+#define FAT_NODE_BUCKETS 64
+
+// Directory entry cache: hash buckets of a few entries each, replaced LRU
+#define FAT_DENTRY_BUCKETS 64
+#define FAT_DENTRY_WAYS 4
+
 typedef struct
 {
    // extended boot record
@@ -41,6 +81,18 @@ typedef struct
    FAT_ExtendedBootRecord EBR;
 } __attribute__((packed)) FAT32_ExtendedBootRecord;
 
+// FAT32 FSInfo sector
+typedef struct
+{
+   uint32_t LeadSignature;
+   uint8_t _Reserved1[480];
+   uint32_t StructSignature;
+   uint32_t FreeCount; // Free clusters, FAT_FREE_UNKNOWN if not known
+   uint32_t NextFree;  // Hint where to look for free clusters
+   uint8_t _Reserved2[12];
+   uint32_t TrailSignature;
+} __attribute__((packed)) FAT_FSInfo;
+
 typedef struct
 {
    uint8_t BootJumpInstruction[3];
@@ -65,11 +117,38 @@ typedef struct
    } ExtendedBootRecord;
 } __attribute__((packed)) FAT_BootSector;
 
+// A run of physically contiguous clusters of a file
+typedef struct
+{
+   uint32_t FileCluster; // Index of the first cluster within the file
+   uint32_t DiskCluster; // Its cluster number on disk
+   uint32_t Length;      // Clusters in the run
+} FAT_Extent;
+
+// State shared by every handle open on the same file, like an inode.
+// Nodes of files with a cluster chain are found by their first cluster.
+typedef struct FAT_Node
+{
+   struct FAT_Node *Next; // Hash chain
+   uint32_t RefCount;     // Open handles
+   bool Hashed;           // Cleared once the file is deleted
+   uint32_t FirstCluster;
+   uint32_t Size;
+   uint32_t Generation; // Bumped whenever the file's data changes
+   bool Preallocated;   // The chain may reach past Size, trimmed on close
+
+   // Cluster chain, built lazily as far as it has been accessed
+   FAT_Extent Extents[FAT_MAX_EXTENTS];
+   uint32_t ExtentCount;
+} FAT_Node;
+
+// An open handle: its position in the file and the sector under it
 typedef struct
 {
    uint8_t Buffer[SECTOR_SIZE];
    FAT_File Public;
-   bool Opened;
+   FAT_Node *Node;
+   uint32_t Generation; // Node generation Buffer was read at
    uint32_t FirstCluster;
    uint32_t CurrentCluster;
    uint32_t CurrentSectorInCluster;
@@ -78,8 +157,29 @@ typedef struct
    uint32_t ParentCluster;
    bool ParentIsRoot;
 
+   // Sequential read detection and read-ahead
+   uint32_t ReadEnd;           // Position where the last FAT_Read stopped
+   uint32_t ReadAheadWindow;   // Clusters per read-ahead, 0 = random access
+   uint32_t ReadAheadClusters; // Clusters from CurrentCluster on in cache
+
+   // Streaming append detection and chain growth
+   uint32_t WriteEnd;       // Position where the last FAT_Write stopped
+   uint32_t AppendClusters; // Clusters added by the last chain extension
+
 } FAT_FileData;
 
+// Cached result of looking a name up in a directory. Directories are keyed
+// by their first cluster, the root directory by 0.
+typedef struct
+{
+   bool Valid;
+   bool Negative; // The name does not exist in the directory
+   uint32_t Directory;
+   char Name[11];
+   uint32_t LastUsed;
+   FAT_DirectoryEntry Entry;
+} FAT_Dentry;
+
 typedef struct
 {
    union
@@ -88,13 +188,40 @@ typedef struct
       uint8_t BootSectorBytes[SECTOR_SIZE];
    } BS;
 
+   Partition *Disk; // Mounted partition, NULL while (re)mounting
    FAT_FileData RootDirectory;
+   FAT_Node RootNode;
 
-   FAT_FileData OpenedFiles[MAX_FILE_HANDLES];
+   // Open handles, indexed by FAT_File.Handle; unused slots are NULL
+   FAT_FileData **Handles;
+   uint32_t HandleCapacity;
+   FAT_Node *Nodes[FAT_NODE_BUCKETS];
 
    uint8_t FatCache[FAT_CACHE_SIZE * SECTOR_SIZE];
    uint32_t FatCachePos;
 
+   // Modified sectors of the first FAT copy when FatTable is not in use
+   uint32_t DirtyFatSectors[FAT_DIRTY_SECTORS];
+   uint8_t DirtyFatData[FAT_DIRTY_SECTORS * SECTOR_SIZE];
+   uint32_t DirtyFatCount;
+
+   // Whole-FAT table (FAT_MOUNT_TABLE), FatTable is NULL when not in use
+   uint8_t *FatTable;      // Image of the first FAT copy
+   uint32_t *DirtySectors; // Bitmap of FAT sectors not yet written back
+   uint32_t *FreeBitmap;   // Bitmap of clusters, set = free
+   uint16_t *GroupFree;    // Free clusters per FAT_GROUP_CLUSTERS group
+
+   // Allocation state, seeded from FSInfo on FAT32 and kept current here
+   uint32_t FreeClusters; // FAT_FREE_UNKNOWN until known
+   bool FreeExact;        // FreeClusters was counted, not taken from FSInfo
+   uint32_t NextFree;     // Where the next free cluster search starts
+   uint32_t FSInfoLba;    // 0 if the volume has no valid FSInfo sector
+   bool FSInfoDirty;
+
+   FAT_Dentry Dentries[FAT_DENTRY_BUCKETS][FAT_DENTRY_WAYS];
+   uint32_t DentryClock;
+   uint32_t ReadErrors; // Failed FAT and data reads, see FAT_FindFile
+
 } FAT_Data;
 
 static FAT_Data *g_Data;
@@ -104,15 +231,31 @@ static uint32_t g_TotalSectors;
 static uint32_t g_SectorsPerFat;
 static uint32_t g_RootDirLba = 0;
 static uint32_t g_RootDirSectors = 0;
+static uint32_t g_ClusterCount; // Clusters 2..g_ClusterCount-1 hold data
 
 // Forward declaration
 uint32_t FAT_ClusterToLba(uint32_t cluster);
+uint32_t FAT_NextCluster(Partition *disk, uint32_t currentCluster);
 
 bool FAT_ReadFat(Partition *disk, size_t LBAIndex)
 {
-   return Partition_ReadSectors(
-       disk, g_Data->BS.BootSector.ReservedSectors + LBAIndex, FAT_CACHE_SIZE,
-       g_Data->FatCache);
+   if (!Partition_ReadSectors(disk,
+                              g_Data->BS.BootSector.ReservedSectors + LBAIndex,
+                              FAT_CACHE_SIZE, g_Data->FatCache))
+   {
+      g_Data->ReadErrors++;
+      return false;
+   }
+
+   // Sectors changed but not flushed yet are newer than the disk
+   for (uint32_t i = 0; i < g_Data->DirtyFatCount; i++)
+   {
+      uint32_t sector = g_Data->DirtyFatSectors[i];
+      if (sector >= LBAIndex && sector < LBAIndex + FAT_CACHE_SIZE)
+         memcpy(g_Data->FatCache + (sector - LBAIndex) * SECTOR_SIZE,
+                g_Data->DirtyFatData + i * SECTOR_SIZE, SECTOR_SIZE);
+   }
+   return true;
 }
 
 void FAT_Detect(Partition *disk)
@@ -127,7 +270,11 @@ void FAT_Detect(Partition *disk)
       g_FatType = 32;
 }
 
-bool FAT_Initialize(Partition *disk)
+static bool FAT_LoadTable(Partition *disk);
+static void FAT_FreeTable(void);
+static void FAT_LoadFSInfo(Partition *disk);
+
+bool FAT_Initialize(Partition *disk, uint32_t flags)
 {
    /* Stage2 preloads the boot sector and root directory at MEMORY_FAT_ADDR
     * (0x20000). We need to allocate our own FAT_Data structure in a different
@@ -144,23 +291,25 @@ bool FAT_Initialize(Partition *disk)
    memcpy(g_Data->BS.BootSectorBytes, preloaded_boot, SECTOR_SIZE);
 
    // Debug: print BPB values
-   printf("[FAT] BPB BytesPerSector=%u, SectorsPerCluster=%u\n",
-          g_Data->BS.BootSector.BytesPerSector,
-          g_Data->BS.BootSector.SectorsPerCluster);
+   TRACE_INFO(FAT, "[FAT] BPB BytesPerSector=%u, SectorsPerCluster=%u\n",
+              g_Data->BS.BootSector.BytesPerSector,
+              g_Data->BS.BootSector.SectorsPerCluster);
 
    // Validate critical BPB values to prevent divide-by-zero later
    if (g_Data->BS.BootSector.BytesPerSector == 0 ||
        g_Data->BS.BootSector.SectorsPerCluster == 0)
    {
-      printf("[FAT] Invalid BPB (BytesPerSector=%u, "
-             "SectorsPerCluster=%u)\n",
-             g_Data->BS.BootSector.BytesPerSector,
-             g_Data->BS.BootSector.SectorsPerCluster);
+      TRACE_ERROR(FAT, "[FAT] Invalid BPB (BytesPerSector=%u, "
+                  "SectorsPerCluster=%u)\n",
+                  g_Data->BS.BootSector.BytesPerSector,
+                  g_Data->BS.BootSector.SectorsPerCluster);
       return false;
    }
 
    // read FAT
+   g_Data->Disk = NULL;
    g_Data->FatCachePos = 0xFFFFFFFF;
+   g_Data->DirtyFatCount = 0;
 
    g_TotalSectors = g_Data->BS.BootSector.TotalSectors;
    if (g_TotalSectors == 0)
@@ -190,10 +339,11 @@ bool FAT_Initialize(Partition *disk)
       g_DataSectionLba = g_Data->BS.BootSector.ReservedSectors +
                          g_SectorsPerFat * g_Data->BS.BootSector.FatCount;
 
-      printf("[FAT] ReservedSectors=%u, SectorsPerFat=%u, FatCount=%u\n",
-             g_Data->BS.BootSector.ReservedSectors, g_SectorsPerFat,
-             g_Data->BS.BootSector.FatCount);
-      printf("[FAT] g_DataSectionLba=%u\n", g_DataSectionLba);
+      TRACE_INFO(FAT,
+                 "[FAT] ReservedSectors=%u, SectorsPerFat=%u, FatCount=%u\n",
+                 g_Data->BS.BootSector.ReservedSectors, g_SectorsPerFat,
+                 g_Data->BS.BootSector.FatCount);
+      TRACE_INFO(FAT, "[FAT] g_DataSectionLba=%u\n", g_DataSectionLba);
 
       // For FAT32 the root directory is a normal cluster chain starting at
       // RootDirectoryCluster. Keep cluster number in
@@ -233,7 +383,6 @@ bool FAT_Initialize(Partition *disk)
    else
       g_Data->RootDirectory.Public.Size =
           sizeof(FAT_DirectoryEntry) * g_Data->BS.BootSector.DirEntryCount;
-   g_Data->RootDirectory.Opened = true;
    g_Data->RootDirectory.ParentCluster = g_Data->RootDirectory.FirstCluster;
    g_Data->RootDirectory.ParentIsRoot = true;
    if (isFat32)
@@ -262,10 +411,33 @@ bool FAT_Initialize(Partition *disk)
    // calculate data section
    FAT_Detect(disk);
 
+   // Highest cluster number + 1, bounded by what the FAT can describe
+   uint32_t fatEntries = g_SectorsPerFat * SECTOR_SIZE * 8 / g_FatType;
+   g_ClusterCount = min((g_TotalSectors - g_DataSectionLba) /
+                                g_Data->BS.BootSector.SectorsPerCluster +
+                            2,
+                        fatEntries);
+
+   FAT_LoadFSInfo(disk);
+
+   FAT_FreeTable();
+   if ((flags & FAT_MOUNT_TABLE) && !FAT_LoadTable(disk))
+      TRACE_INFO(FAT, "[FAT] FAT table not cached, using the sector window\n");
+
    // reset opened files
-   for (int i = 0; i < MAX_FILE_HANDLES; i++)
-      g_Data->OpenedFiles[i].Opened = false;
+   for (uint32_t i = 0; i < g_Data->HandleCapacity; i++)
+      if (g_Data->Handles[i]) FAT_Close(&g_Data->Handles[i]->Public);
+
+   memset(&g_Data->RootNode, 0, sizeof(g_Data->RootNode));
+   g_Data->RootNode.RefCount = 1;
+   g_Data->RootNode.FirstCluster = g_Data->RootDirectory.FirstCluster;
+   g_Data->RootNode.Size = g_Data->RootDirectory.Public.Size;
+   g_Data->RootDirectory.Node = &g_Data->RootNode;
+   g_Data->RootDirectory.Generation = 0;
 
+   memset(g_Data->Dentries, 0, sizeof(g_Data->Dentries));
+
+   g_Data->Disk = disk;
    return true;
 }
 
@@ -276,192 +448,847 @@ uint32_t FAT_ClusterToLba(uint32_t cluster)
    return lba;
 }
 
-// Write a FAT entry for the given cluster across all FAT copies and update the
-// in-memory cache if it covers the written sector. Value should be masked to
-// the appropriate width by caller (e.g., EOF marker or 0 for free).
-static bool FAT_WriteFatEntry(Partition *disk, uint32_t cluster, uint32_t value)
+// Byte offset of a cluster's entry within the FAT
+static uint32_t FAT_EntryOffset(uint32_t cluster)
+{
+   if (g_FatType == 12) return cluster * 3 / 2;
+   if (g_FatType == 16) return cluster * 2;
+   return cluster * 4;
+}
+
+// Decode the entry of `cluster` found at `fat` (its FAT_EntryOffset). End of
+// chain markers are sign-extended so they compare >= 0x0FFFFFF8.
+static uint32_t FAT_DecodeEntry(const uint8_t *fat, uint32_t cluster)
 {
-   uint32_t fatByteOffset;
+   uint32_t nextCluster;
    if (g_FatType == 12)
-      fatByteOffset = cluster * 3 / 2;
+   {
+      if (cluster % 2 == 0)
+         nextCluster = (*(uint16_t *)fat) & 0x0fff;
+      else
+         nextCluster = (*(uint16_t *)fat) >> 4;
+
+      if (nextCluster >= 0xff8) nextCluster |= 0xfffff000;
+   }
    else if (g_FatType == 16)
-      fatByteOffset = cluster * 2;
+   {
+      nextCluster = *(uint16_t *)fat;
+      if (nextCluster >= 0xfff8) nextCluster |= 0xffff0000;
+   }
    else
-      fatByteOffset = cluster * 4;
+   {
+      nextCluster = *(uint32_t *)fat & 0x0FFFFFFF;
+   }
+   return nextCluster;
+}
 
-   uint32_t fatSectorOffset = fatByteOffset / SECTOR_SIZE;
-   uint32_t fatByteOffsetInSector = fatByteOffset % SECTOR_SIZE;
+static void FAT_FreeTable(void)
+{
+   free(g_Data->FatTable);
+   free(g_Data->DirtySectors);
+   free(g_Data->FreeBitmap);
+   free(g_Data->GroupFree);
+   g_Data->FatTable = NULL;
+   g_Data->DirtySectors = NULL;
+   g_Data->FreeBitmap = NULL;
+   g_Data->GroupFree = NULL;
+}
 
-   // Iterate over all FAT copies
-   for (uint32_t fatIdx = 0; fatIdx < g_Data->BS.BootSector.FatCount; fatIdx++)
-   {
-      uint32_t fatSectorLba = g_Data->BS.BootSector.ReservedSectors +
-                              fatIdx * g_SectorsPerFat + fatSectorOffset;
+// Read the FAT32 FSInfo sector and take its free count and next free hint
+// as the starting allocation state. Values out of range are ignored.
+static void FAT_LoadFSInfo(Partition *disk)
+{
+   g_Data->FreeClusters = FAT_FREE_UNKNOWN;
+   g_Data->FreeExact = false;
+   g_Data->NextFree = 2;
+   g_Data->FSInfoLba = 0;
+   g_Data->FSInfoDirty = false;
+
+   if (g_FatType != 32) return;
+
+   uint16_t sector =
+       g_Data->BS.BootSector.ExtendedBootRecord.EBR32.FSInfoSector;
+   if (sector == 0 || sector == 0xFFFF ||
+       sector >= g_Data->BS.BootSector.ReservedSectors)
+      return;
+
+   FAT_FSInfo info;
+   if (!Partition_ReadSectors(disk, sector, 1, &info)) return;
+   if (info.LeadSignature != FAT_FSINFO_LEAD_SIGNATURE ||
+       info.StructSignature != FAT_FSINFO_STRUCT_SIGNATURE ||
+       info.TrailSignature != FAT_FSINFO_TRAIL_SIGNATURE)
+   {
+      TRACE_ERROR(FAT,
+                  "[FAT] FSInfo sector %u has bad signatures, ignoring it\n",
+                  sector);
+      return;
+   }
+
+   g_Data->FSInfoLba = sector;
+   if (info.FreeCount <= g_ClusterCount - 2)
+      g_Data->FreeClusters = info.FreeCount;
+   if (info.NextFree >= 2 && info.NextFree < g_ClusterCount)
+      g_Data->NextFree = info.NextFree;
+}
 
-      uint8_t fatBuffer[SECTOR_SIZE * 2];
-      if (!Partition_ReadSectors(disk, fatSectorLba, 1, fatBuffer))
-         return false;
+// Write the current free count and next free hint back to FSInfo
+static bool FAT_FlushFSInfo(Partition *disk)
+{
+   if (g_Data->FSInfoLba == 0 || !g_Data->FSInfoDirty) return true;
 
-      bool crossBoundary =
-          (g_FatType == 12 && fatByteOffsetInSector == SECTOR_SIZE - 1);
-      if (crossBoundary)
+   FAT_FSInfo info;
+   if (!Partition_ReadSectors(disk, g_Data->FSInfoLba, 1, &info)) return false;
+   info.FreeCount = g_Data->FreeClusters;
+   info.NextFree = g_Data->NextFree;
+   if (!Partition_WriteSectors(disk, g_Data->FSInfoLba, 1, &info))
+      return false;
+
+   g_Data->FSInfoDirty = false;
+   return true;
+}
+
+// Account for a FAT entry changing between free and allocated
+static void FAT_SetClusterFree(uint32_t cluster, bool wasFree, bool isFree)
+{
+   if (wasFree == isFree) return;
+
+   if (g_Data->FreeBitmap)
+   {
+      uint32_t bit = 1u << (cluster % 32);
+      if (isFree)
       {
-         if (!Partition_ReadSectors(disk, fatSectorLba + 1, 1,
-                                    fatBuffer + SECTOR_SIZE))
-            return false;
+         g_Data->FreeBitmap[cluster / 32] |= bit;
+         g_Data->GroupFree[cluster / FAT_GROUP_CLUSTERS]++;
+      }
+      else
+      {
+         g_Data->FreeBitmap[cluster / 32] &= ~bit;
+         g_Data->GroupFree[cluster / FAT_GROUP_CLUSTERS]--;
       }
+   }
 
-      if (g_FatType == 12)
+   if (g_Data->FreeClusters != FAT_FREE_UNKNOWN)
+   {
+      if (isFree)
+         g_Data->FreeClusters++;
+      else if (g_Data->FreeClusters > 0)
+         g_Data->FreeClusters--;
+      else
       {
-         uint16_t *p = (uint16_t *)(fatBuffer + fatByteOffsetInSector);
-         if (cluster % 2 == 0)
-            *p = (*p & 0xF000) | (value & 0x0FFF);
-         else
-            *p = (*p & 0x000F) | ((value & 0x0FFF) << 4);
+         // Allocated a cluster the count said was not there; recount later
+         g_Data->FreeClusters = FAT_FREE_UNKNOWN;
+         g_Data->FreeExact = false;
       }
-      else if (g_FatType == 16)
+      g_Data->FSInfoDirty = true;
+   }
+}
+
+// A search found a free cluster. If the FSInfo count claimed none, it was
+// stale: drop it so FAT_GetUsage counts again.
+static void FAT_FoundFreeCluster(void)
+{
+   if (g_Data->FreeClusters != 0) return;
+   g_Data->FreeClusters = FAT_FREE_UNKNOWN;
+   g_Data->FreeExact = false;
+   g_Data->FSInfoDirty = true;
+}
+
+// A search went over every cluster without finding a free one
+static void FAT_NoFreeClusters(void)
+{
+   if (g_Data->FreeClusters != 0) g_Data->FSInfoDirty = true;
+   g_Data->FreeClusters = 0;
+   g_Data->FreeExact = true;
+}
+
+// Read the whole first FAT copy into memory and build the free-cluster
+// bitmap from it. Returns false (leaving the table unused) if the table
+// would take more than 1/FAT_TABLE_HEAP_SHARE of the largest free heap run.
+static bool FAT_LoadTable(Partition *disk)
+{
+   uint32_t fatBytes = g_SectorsPerFat * SECTOR_SIZE;
+   uint32_t groups =
+       (g_ClusterCount + FAT_GROUP_CLUSTERS - 1) / FAT_GROUP_CLUSTERS;
+
+   uint64_t needed = (uint64_t)fatBytes + 1 +
+                     (g_SectorsPerFat + 31) / 32 * 4 +
+                     (g_ClusterCount + 31) / 32 * 4 +
+                     groups * sizeof(uint16_t);
+   HeapStats stats;
+   heap_stats(&stats);
+   if (needed > stats.largest_free_run / FAT_TABLE_HEAP_SHARE)
+   {
+      TRACE_INFO(FAT, "[FAT] FAT table needs %u KiB, heap run is %u KiB\n",
+                 (uint32_t)(needed / 1024), stats.largest_free_run / 1024);
+      return false;
+   }
+
+   // One spare byte: a FAT12 entry is read as 16 bits
+   g_Data->FatTable = kmalloc(fatBytes + 1);
+   g_Data->DirtySectors = kzalloc((g_SectorsPerFat + 31) / 32 * 4);
+   g_Data->FreeBitmap = kzalloc((g_ClusterCount + 31) / 32 * 4);
+   g_Data->GroupFree = kzalloc(groups * sizeof(uint16_t));
+   if (!g_Data->FatTable || !g_Data->DirtySectors || !g_Data->FreeBitmap ||
+       !g_Data->GroupFree)
+   {
+      FAT_FreeTable();
+      return false;
+   }
+
+   if (!Partition_ReadSectors(disk, g_Data->BS.BootSector.ReservedSectors,
+                              g_SectorsPerFat, g_Data->FatTable))
+   {
+      FAT_FreeTable();
+      return false;
+   }
+   g_Data->FatTable[fatBytes] = 0;
+
+   // The table gives the exact free count; correct FSInfo if it disagrees
+   uint32_t freeClusters = 0;
+   for (uint32_t cluster = 2; cluster < g_ClusterCount; cluster++)
+   {
+      uint32_t entry = FAT_DecodeEntry(
+          g_Data->FatTable + FAT_EntryOffset(cluster), cluster);
+      if (entry != 0) continue;
+
+      g_Data->FreeBitmap[cluster / 32] |= 1u << (cluster % 32);
+      g_Data->GroupFree[cluster / FAT_GROUP_CLUSTERS]++;
+      freeClusters++;
+   }
+   if (g_Data->FreeClusters != freeClusters)
+   {
+      g_Data->FreeClusters = freeClusters;
+      g_Data->FSInfoDirty = true;
+   }
+   g_Data->FreeExact = true;
+
+   TRACE_INFO(FAT,
+              "[FAT] FAT table in memory: %u KiB, %u of %u clusters free\n",
+              fatBytes / 1024, g_Data->FreeClusters, g_ClusterCount - 2);
+   return true;
+}
+
+// Write the held back sectors of the window mode to every FAT copy, sorted
+// so that consecutive sectors go out as one request per copy
+static bool FAT_FlushDirtySectors(Partition *disk)
+{
+   uint32_t count = g_Data->DirtyFatCount;
+   uint32_t *sectors = g_Data->DirtyFatSectors;
+   uint8_t *data = g_Data->DirtyFatData;
+   if (count == 0) return true;
+
+   uint8_t temp[SECTOR_SIZE];
+   for (uint32_t i = 1; i < count; i++)
+   {
+      for (uint32_t j = i; j > 0 && sectors[j - 1] > sectors[j]; j--)
       {
-         *(uint16_t *)(fatBuffer + fatByteOffsetInSector) = (uint16_t)value;
+         uint32_t sector = sectors[j];
+         sectors[j] = sectors[j - 1];
+         sectors[j - 1] = sector;
+         memcpy(temp, data + j * SECTOR_SIZE, SECTOR_SIZE);
+         memcpy(data + j * SECTOR_SIZE, data + (j - 1) * SECTOR_SIZE,
+                SECTOR_SIZE);
+         memcpy(data + (j - 1) * SECTOR_SIZE, temp, SECTOR_SIZE);
       }
-      else // FAT32
+   }
+
+   // Runs that failed on any copy are moved to the front and stay held
+   // back, so the next flush retries them
+   uint32_t kept = 0;
+   for (uint32_t i = 0; i < count;)
+   {
+      uint32_t run = 1;
+      while (i + run < count && sectors[i + run] == sectors[i] + run) run++;
+
+      bool written = true;
+      for (uint32_t fatIdx = 0; fatIdx < g_Data->BS.BootSector.FatCount;
+           fatIdx++)
       {
-         uint32_t *entry = (uint32_t *)(fatBuffer + fatByteOffsetInSector);
-         uint32_t oldValue = *entry;
-         // Preserve top 4 bits, set lower 28 bits
-         *entry = (*entry & 0xF0000000) | (value & 0x0FFFFFFF);
-         if (cluster >= 9564 && cluster <= 9580)
+         uint32_t lba = g_Data->BS.BootSector.ReservedSectors +
+                        fatIdx * g_SectorsPerFat + sectors[i];
+         if (!Partition_WriteSectors(disk, lba, run, data + i * SECTOR_SIZE))
          {
-            printf("FAT_WriteFatEntry: cluster=%u, oldValue=0x%08x, "
-                   "newValue=0x%08x, LBA=%u, offset=%u\n",
-                   cluster, oldValue, *entry, fatSectorLba,
-                   fatByteOffsetInSector);
+            TRACE_ERROR(FAT, "[FAT] FAT write back failed at sector %u\n", lba);
+            written = false;
          }
       }
 
-      if (!Partition_WriteSectors(disk, fatSectorLba, 1, fatBuffer))
-         return false;
-
-      if (crossBoundary)
+      if (!written)
       {
-         if (!Partition_WriteSectors(disk, fatSectorLba + 1, 1,
-                                     fatBuffer + SECTOR_SIZE))
-            return false;
+         if (kept != i)
+         {
+            memmove(sectors + kept, sectors + i, run * sizeof(uint32_t));
+            memmove(data + kept * SECTOR_SIZE, data + i * SECTOR_SIZE,
+                    run * SECTOR_SIZE);
+         }
+         kept += run;
       }
+      i += run;
    }
 
-   // Update cache if this sector is currently cached (cache covers FAT copy 0)
-   if (g_Data->FatCachePos != 0xFFFFFFFF)
+   g_Data->DirtyFatCount = kept;
+   return kept == 0;
+}
+
+// Write all FAT changes made since the last flush to every FAT copy.
+// Consecutive dirty sectors are written with a single request per copy.
+static bool FAT_FlushFat(Partition *disk)
+{
+   if (!g_Data->FatTable) return FAT_FlushDirtySectors(disk);
+
+   bool ok = true;
+   uint32_t sector = 0;
+   while (sector < g_SectorsPerFat)
    {
-      // Check first sector
-      if (fatSectorOffset >= g_Data->FatCachePos &&
-          fatSectorOffset < g_Data->FatCachePos + FAT_CACHE_SIZE)
+      if (!(g_Data->DirtySectors[sector / 32] & (1u << (sector % 32))))
+      {
+         // Skip clean words quickly
+         if (sector % 32 == 0 && g_Data->DirtySectors[sector / 32] == 0)
+            sector += 32;
+         else
+            sector++;
+         continue;
+      }
+
+      uint32_t run = 0;
+      while (sector + run < g_SectorsPerFat &&
+             (g_Data->DirtySectors[(sector + run) / 32] &
+              (1u << ((sector + run) % 32))))
+         run++;
+
+      bool written = true;
+      for (uint32_t fatIdx = 0; fatIdx < g_Data->BS.BootSector.FatCount;
+           fatIdx++)
       {
-         uint8_t *cache = g_Data->FatCache +
-                          (fatSectorOffset - g_Data->FatCachePos) * SECTOR_SIZE;
-         if (g_FatType == 12)
+         uint32_t lba = g_Data->BS.BootSector.ReservedSectors +
+                        fatIdx * g_SectorsPerFat + sector;
+         if (!Partition_WriteSectors(disk, lba, run,
+                                     g_Data->FatTable + sector * SECTOR_SIZE))
          {
-            uint16_t *p = (uint16_t *)(cache + fatByteOffsetInSector);
-            // Note: This is unsafe if crossing boundary of the CACHE buffer.
-            // But FatCache is 5 sectors. If fatByteOffsetInSector is 511,
-            // we access cache[511] and cache[512].
-            // If fatSectorOffset is the last sector of cache, cache[512] is out
-            // of bounds. However, we can just invalidate the cache to be safe
-            // and simple.
-            g_Data->FatCachePos = 0xFFFFFFFF;
+            TRACE_ERROR(FAT, "[FAT] FAT write back failed at sector %u\n", lba);
+            written = false;
          }
-         else if (g_FatType == 16)
+      }
+
+      // Sectors that failed on any copy stay dirty for the next flush
+      if (written)
+         for (uint32_t i = sector; i < sector + run; i++)
+            g_Data->DirtySectors[i / 32] &= ~(1u << (i % 32));
+      else
+         ok = false;
+      sector += run;
+   }
+   return ok;
+}
+
+// Find a free cluster, preferring `hint` and the clusters after it so that
+// files grow contiguously. Returns 0 if the volume is full.
+static uint32_t FAT_ScanFreeCluster(Partition *disk, uint32_t hint)
+{
+   if (hint < 2 || hint >= g_ClusterCount) hint = 2;
+   // FSInfo's count is only a hint; trust a 0 only if it was counted
+   if (g_Data->FreeExact && g_Data->FreeClusters == 0) return 0;
+
+   if (!g_Data->FatTable)
+   {
+      for (uint32_t i = 0; i < g_ClusterCount - 2; i++)
+      {
+         uint32_t cluster = hint + i;
+         if (cluster >= g_ClusterCount) cluster -= g_ClusterCount - 2;
+         if (FAT_NextCluster(disk, cluster) == 0)
          {
-            *(uint16_t *)(cache + fatByteOffsetInSector) = (uint16_t)value;
+            FAT_FoundFreeCluster();
+            return cluster;
          }
-         else // FAT32
+      }
+      FAT_NoFreeClusters();
+      return 0;
+   }
+
+   // Scan the bitmap from the hint, skipping full words and full groups,
+   // then wrap around once
+   uint32_t words = (g_ClusterCount + 31) / 32;
+   uint32_t groupWords = FAT_GROUP_CLUSTERS / 32;
+   uint32_t word = hint / 32;
+   uint32_t mask = ~0u << (hint % 32);
+   for (uint32_t scanned = 0; scanned <= words; scanned++, word++, mask = ~0u)
+   {
+      if (word >= words) word = 0;
+      if (word % groupWords == 0 && g_Data->GroupFree[word / groupWords] == 0)
+      {
+         scanned += groupWords - 1;
+         word += groupWords - 1;
+         continue;
+      }
+
+      uint32_t bits = g_Data->FreeBitmap[word] & mask;
+      if (bits == 0) continue;
+
+      uint32_t cluster = word * 32 + __builtin_ctz(bits);
+      if (cluster >= 2 && cluster < g_ClusterCount) return cluster;
+   }
+   return 0;
+}
+
+// FAT_ScanFreeCluster that also moves the allocation cursor (FSInfo's next
+// free hint) past the cluster found, for the caller to allocate it
+static uint32_t FAT_FindFreeCluster(Partition *disk, uint32_t hint)
+{
+   uint32_t cluster = FAT_ScanFreeCluster(disk, hint);
+   if (cluster != 0)
+   {
+      g_Data->NextFree = (cluster + 1 < g_ClusterCount) ? cluster + 1 : 2;
+      g_Data->FSInfoDirty = true;
+   }
+   return cluster;
+}
+
+// Store a FAT entry at `fat` (its FAT_EntryOffset), keeping the bits that
+// belong to the neighbouring FAT12 entry and the reserved top of FAT32
+static void FAT_StoreEntry(uint8_t *fat, uint32_t cluster, uint32_t value)
+{
+   if (g_FatType == 12)
+   {
+      uint16_t *p = (uint16_t *)fat;
+      if (cluster % 2 == 0)
+         *p = (*p & 0xF000) | (value & 0x0FFF);
+      else
+         *p = (*p & 0x000F) | ((value & 0x0FFF) << 4);
+   }
+   else if (g_FatType == 16)
+   {
+      *(uint16_t *)fat = (uint16_t)value;
+   }
+   else
+   {
+      uint32_t *entry = (uint32_t *)fat;
+      *entry = (*entry & 0xF0000000) | (value & 0x0FFFFFFF);
+   }
+}
+
+// Held back copy of a sector of the first FAT, loaded on first use. The
+// caller makes room with FAT_FlushDirtySectors beforehand.
+static uint8_t *FAT_DirtySector(Partition *disk, uint32_t sector)
+{
+   for (uint32_t i = 0; i < g_Data->DirtyFatCount; i++)
+      if (g_Data->DirtyFatSectors[i] == sector)
+         return g_Data->DirtyFatData + i * SECTOR_SIZE;
+
+   uint8_t *data =
+       g_Data->DirtyFatData + g_Data->DirtyFatCount * SECTOR_SIZE;
+   if (!Partition_ReadSectors(disk,
+                              g_Data->BS.BootSector.ReservedSectors + sector,
+                              1, data))
+      return NULL;
+
+   g_Data->DirtyFatSectors[g_Data->DirtyFatCount++] = sector;
+   return data;
+}
+
+// Change the FAT entry of a cluster. The change is made in memory, either in
+// the whole-FAT table or in held back FAT sectors; FAT_FlushFat writes it to
+// every FAT copy. Value should be masked to the appropriate width by caller
+// (e.g., EOF marker or 0 for free).
+static bool FAT_WriteFatEntry(Partition *disk, uint32_t cluster, uint32_t value)
+{
+   uint32_t fatByteOffset = FAT_EntryOffset(cluster);
+
+   uint32_t fatSectorOffset = fatByteOffset / SECTOR_SIZE;
+   uint32_t fatByteOffsetInSector = fatByteOffset % SECTOR_SIZE;
+   bool crossBoundary =
+       (g_FatType == 12 && fatByteOffsetInSector == SECTOR_SIZE - 1);
+
+   if (g_Data->FatTable)
+   {
+      uint8_t *fat = g_Data->FatTable + fatByteOffset;
+      uint32_t previous = FAT_DecodeEntry(fat, cluster);
+      FAT_StoreEntry(fat, cluster, value);
+
+      g_Data->DirtySectors[fatSectorOffset / 32] |=
+          1u << (fatSectorOffset % 32);
+      if (crossBoundary)
+         g_Data->DirtySectors[(fatSectorOffset + 1) / 32] |=
+             1u << ((fatSectorOffset + 1) % 32);
+
+      if (cluster >= 2 && cluster < g_ClusterCount)
+         FAT_SetClusterFree(cluster, previous == 0, value == 0);
+      return true;
+   }
+
+   // A FAT12 entry can straddle two sectors
+   if (g_Data->DirtyFatCount + 2 > FAT_DIRTY_SECTORS &&
+       !FAT_FlushDirtySectors(disk))
+      return false;
+
+   uint8_t *first = FAT_DirtySector(disk, fatSectorOffset);
+   uint8_t *second =
+       crossBoundary ? FAT_DirtySector(disk, fatSectorOffset + 1) : NULL;
+   if (!first || (crossBoundary && !second)) return false;
+
+   uint32_t entrySize = g_FatType == 32 ? 4 : 2;
+   uint8_t entry[4];
+   if (crossBoundary)
+   {
+      entry[0] = first[SECTOR_SIZE - 1];
+      entry[1] = second[0];
+   }
+   else
+   {
+      memcpy(entry, first + fatByteOffsetInSector, entrySize);
+   }
+
+   uint32_t previous = FAT_DecodeEntry(entry, cluster);
+   FAT_StoreEntry(entry, cluster, value);
+
+   if (crossBoundary)
+   {
+      first[SECTOR_SIZE - 1] = entry[0];
+      second[0] = entry[1];
+   }
+   else
+   {
+      memcpy(first + fatByteOffsetInSector, entry, entrySize);
+   }
+
+   if (cluster >= 2 && cluster < g_ClusterCount)
+      FAT_SetClusterFree(cluster, previous == 0, value == 0);
+
+   // Keep the read window in step with the held back sectors
+   for (uint32_t sector = fatSectorOffset;
+        sector <= fatSectorOffset + (crossBoundary ? 1 : 0); sector++)
+   {
+      if (g_Data->FatCachePos != 0xFFFFFFFF && sector >= g_Data->FatCachePos &&
+          sector < g_Data->FatCachePos + FAT_CACHE_SIZE)
+         memcpy(g_Data->FatCache +
+                    (sector - g_Data->FatCachePos) * SECTOR_SIZE,
+                sector == fatSectorOffset ? first : second, SECTOR_SIZE);
+   }
+
+   return true;
+}
+
+static bool FAT_IsClusterFree(Partition *disk, uint32_t cluster)
+{
+   if (g_Data->FreeBitmap)
+      return (g_Data->FreeBitmap[cluster / 32] & (1u << (cluster % 32))) != 0;
+   return FAT_NextCluster(disk, cluster) == 0;
+}
+
+// Find `count` free clusters in a row, searching from the hint and wrapping
+// around once. Returns the first cluster of the first run long enough, or
+// else of the longest run seen, and its length in *length. Returns 0 if no
+// cluster is free.
+static uint32_t FAT_FindFreeRun(Partition *disk, uint32_t hint, uint32_t count,
+                                uint32_t *length)
+{
+   *length = 0;
+   if (hint < 2 || hint >= g_ClusterCount) hint = 2;
+   if (count == 0) return 0;
+   if (g_Data->FreeExact && g_Data->FreeClusters == 0) return 0;
+
+   uint32_t best = 0;
+   uint32_t runStart = 0;
+   uint32_t runLength = 0;
+   uint32_t cluster = hint;
+   for (uint32_t scanned = 0; scanned < g_ClusterCount - 2;
+        scanned++, cluster++)
+   {
+      // Runs do not wrap from the last cluster to the first
+      if (cluster >= g_ClusterCount)
+      {
+         cluster = 2;
+         runLength = 0;
+      }
+
+      // Groups without a free cluster end any run
+      if (g_Data->GroupFree && cluster % FAT_GROUP_CLUSTERS == 0 &&
+          g_Data->GroupFree[cluster / FAT_GROUP_CLUSTERS] == 0)
+      {
+         scanned += FAT_GROUP_CLUSTERS - 1;
+         cluster += FAT_GROUP_CLUSTERS - 1;
+         runLength = 0;
+         continue;
+      }
+
+      if (!FAT_IsClusterFree(disk, cluster))
+      {
+         runLength = 0;
+         continue;
+      }
+
+      if (runLength++ == 0) runStart = cluster;
+      if (runLength > *length)
+      {
+         best = runStart;
+         *length = runLength;
+      }
+      if (runLength == count) break;
+   }
+
+   // Only a full scan ends without a run
+   if (best == 0)
+      FAT_NoFreeClusters();
+   else
+      FAT_FoundFreeCluster();
+   return best;
+}
+
+// Append up to `count` clusters to the chain ending at `last`, taking the
+// longest free runs from right after it on so the file stays contiguous.
+// Returns how many clusters were added and the first of them in *first.
+static uint32_t FAT_ExtendChain(Partition *disk, uint32_t last, uint32_t count,
+                                uint32_t *first)
+{
+   uint32_t eofVal = (g_FatType == 12)   ? 0x0FFF
+                     : (g_FatType == 16) ? 0xFFFF
+                                         : 0x0FFFFFFF;
+   uint32_t added = 0;
+   while (added < count)
+   {
+      uint32_t length;
+      uint32_t run = FAT_FindFreeRun(disk, last + 1, count - added, &length);
+      if (run == 0) break;
+
+      for (uint32_t i = 0; i < length; i++)
+      {
+         uint32_t value = (i + 1 < length) ? run + i + 1 : eofVal;
+         if (!FAT_WriteFatEntry(disk, run + i, value)) return added;
+      }
+      if (!FAT_WriteFatEntry(disk, last, run)) return added;
+
+      if (added == 0) *first = run;
+      added += length;
+      last = run + length - 1;
+
+      g_Data->NextFree = (last + 1 < g_ClusterCount) ? last + 1 : 2;
+      g_Data->FSInfoDirty = true;
+   }
+   return added;
+}
+
+static bool FAT_IsDataCluster(uint32_t cluster)
+{
+   uint32_t eofMarker = (g_FatType == 12)   ? 0xFF8
+                        : (g_FatType == 16) ? 0xFFF8
+                                            : 0x0FFFFFF8;
+   return cluster >= 2 && cluster < eofMarker;
+}
+
+static uint32_t FAT_EntryCluster(const FAT_DirectoryEntry *entry)
+{
+   return entry->FirstClusterLow + ((uint32_t)entry->FirstClusterHigh << 16);
+}
+
+// Handle data of an open file, NULL for an invalid handle
+static FAT_FileData *FAT_GetData(FAT_File *file)
+{
+   if (file->Handle == ROOT_DIRECTORY_HANDLE) return &g_Data->RootDirectory;
+   if (file->Handle < 0 || (uint32_t)file->Handle >= g_Data->HandleCapacity)
+      return NULL;
+   return g_Data->Handles[file->Handle];
+}
+
+// Claim a free slot in the handle table, doubling the table when it is full.
+// Returns -1 if memory is exhausted.
+static int FAT_AllocateHandle(void)
+{
+   for (uint32_t i = 0; i < g_Data->HandleCapacity; i++)
+      if (!g_Data->Handles[i]) return i;
+
+   uint32_t capacity = g_Data->HandleCapacity ? g_Data->HandleCapacity * 2
+                                              : FAT_INITIAL_HANDLES;
+   FAT_FileData **handles =
+       realloc(g_Data->Handles, capacity * sizeof(FAT_FileData *));
+   if (!handles) return -1;
+
+   memset(handles + g_Data->HandleCapacity, 0,
+          (capacity - g_Data->HandleCapacity) * sizeof(FAT_FileData *));
+   int handle = g_Data->HandleCapacity;
+   g_Data->Handles = handles;
+   g_Data->HandleCapacity = capacity;
+   return handle;
+}
+
+static FAT_Node **FAT_NodeBucket(uint32_t firstCluster)
+{
+   return &g_Data->Nodes[firstCluster % FAT_NODE_BUCKETS];
+}
+
+// Take a reference on the node of the file starting at firstCluster,
+// creating it if the file is not open yet. Files without clusters never share
+// a node.
+static FAT_Node *FAT_NodeGet(uint32_t firstCluster, uint32_t size)
+{
+   bool shared = FAT_IsDataCluster(firstCluster);
+   if (shared)
+   {
+      for (FAT_Node *node = *FAT_NodeBucket(firstCluster); node;
+           node = node->Next)
+      {
+         if (node->FirstCluster == firstCluster)
          {
-            uint32_t *entry = (uint32_t *)(cache + fatByteOffsetInSector);
-            // Preserve top 4 bits, set lower 28 bits
-            *entry = (*entry & 0xF0000000) | (value & 0x0FFFFFFF);
+            node->RefCount++;
+            return node;
          }
       }
+   }
 
-      // If we crossed boundary, we might have touched the next sector too.
-      // Simpler to just invalidate cache for FAT12 to avoid complexity.
-      if (g_FatType == 12) g_Data->FatCachePos = 0xFFFFFFFF;
+   FAT_Node *node = kzalloc(sizeof(FAT_Node));
+   if (!node) return NULL;
+   node->RefCount = 1;
+   node->FirstCluster = firstCluster;
+   node->Size = size;
+   if (shared)
+   {
+      node->Hashed = true;
+      node->Next = *FAT_NodeBucket(firstCluster);
+      *FAT_NodeBucket(firstCluster) = node;
    }
+   return node;
+}
 
-   return true;
+// Stop new opens from finding a node, e.g. because its file was deleted
+static void FAT_NodeUnhash(FAT_Node *node)
+{
+   if (!node->Hashed) return;
+
+   for (FAT_Node **link = FAT_NodeBucket(node->FirstCluster); *link;
+        link = &(*link)->Next)
+   {
+      if (*link == node)
+      {
+         *link = node->Next;
+         break;
+      }
+   }
+   node->Hashed = false;
 }
 
-FAT_File *FAT_OpenEntry(Partition *disk, FAT_DirectoryEntry *entry,
-                        FAT_FileData *parent)
+static void FAT_NodePut(FAT_Node *node)
+{
+   if (--node->RefCount > 0) return;
+   FAT_NodeUnhash(node);
+   free(node);
+}
+
+// Node of an open file by first cluster, NULL if it is not open. Like the
+// dentry cache keys, 0 stands for the root directory.
+static FAT_Node *FAT_NodeFind(uint32_t firstCluster)
 {
-   // find empty handle
-   int handle = -1;
-   for (int i = 0; i < MAX_FILE_HANDLES && handle < 0; i++)
+   if (firstCluster == 0) return &g_Data->RootNode;
+   for (FAT_Node *node = *FAT_NodeBucket(firstCluster); node;
+        node = node->Next)
+      if (node->FirstCluster == firstCluster) return node;
+   return NULL;
+}
+
+// Catch a handle up with changes made through other handles of the same
+// file: take over the shared size and re-read the buffered sector.
+static void FAT_RefreshHandle(Partition *disk, FAT_FileData *fd)
+{
+   FAT_Node *node = fd->Node;
+   if (fd->Generation == node->Generation) return;
+   fd->Generation = node->Generation;
+
+   if (!fd->Public.IsDirectory)
    {
-      if (!g_Data->OpenedFiles[i].Opened) handle = i;
+      fd->Public.Size = node->Size;
+
+      // Truncated underneath us: restart at the beginning
+      if (fd->Public.Position > node->Size)
+      {
+         fd->Public.Position = 0;
+         fd->CurrentCluster = fd->FirstCluster;
+         fd->CurrentSectorInCluster = 0;
+      }
    }
 
-   // out of handles
-   if (handle < 0)
+   if (FAT_IsDataCluster(fd->CurrentCluster) &&
+       !Partition_ReadSectors(disk,
+                              FAT_ClusterToLba(fd->CurrentCluster) +
+                                  fd->CurrentSectorInCluster,
+                              1, fd->Buffer))
+      g_Data->ReadErrors++;
+}
+
+// Record a change to a file's data made through fd; other handles of the
+// file pick it up in FAT_RefreshHandle
+static void FAT_Touch(FAT_FileData *fd)
+{
+   fd->Node->Generation++;
+   fd->Generation = fd->Node->Generation;
+   if (!fd->Public.IsDirectory) fd->Node->Size = fd->Public.Size;
+}
+
+// Open a directory entry found in the directory starting at parentCluster
+FAT_File *FAT_OpenEntry(Partition *disk, FAT_DirectoryEntry *entry,
+                        uint32_t parentCluster, bool parentIsRoot)
+{
+   int handle = FAT_AllocateHandle();
+   if (handle < 0) return NULL;
+
+   FAT_FileData *fd = kzalloc(sizeof(FAT_FileData));
+   if (!fd) return NULL;
+
+   uint32_t firstCluster = FAT_EntryCluster(entry);
+   fd->Node = FAT_NodeGet(firstCluster, entry->Size);
+   if (!fd->Node)
    {
-      return false;
+      free(fd);
+      return NULL;
    }
+   g_Data->Handles[handle] = fd;
 
    // setup vars
-   FAT_FileData *fd = &g_Data->OpenedFiles[handle];
    fd->Public.Handle = handle;
    fd->Public.IsDirectory = (entry->Attributes & FAT_ATTRIBUTE_DIRECTORY) != 0;
    fd->Public.Position = 0;
-   fd->Public.Size = entry->Size;
+   // An already open file may have grown past its directory entry
+   fd->Public.Size = fd->Node->Size;
    memcpy(fd->Public.Name, entry->Name, 11); // Save the name
-   fd->FirstCluster =
-       entry->FirstClusterLow + ((uint32_t)entry->FirstClusterHigh << 16);
+   fd->FirstCluster = firstCluster;
+   fd->Generation = fd->Node->Generation;
 
    // Record parent directory information for later updates
-   if (parent != NULL)
-   {
-      fd->ParentCluster = parent->FirstCluster;
-      fd->ParentIsRoot = (parent == &g_Data->RootDirectory);
-   }
-   else
-   {
-      // Fallback: assume root
-      fd->ParentCluster = g_Data->RootDirectory.FirstCluster;
-      fd->ParentIsRoot = true;
-   }
+   fd->ParentCluster = parentCluster;
+   fd->ParentIsRoot = parentIsRoot;
 
    fd->CurrentCluster = fd->FirstCluster;
    fd->CurrentSectorInCluster = 0;
+   fd->ReadEnd = 0;
+   fd->ReadAheadWindow = 0;
+   fd->ReadAheadClusters = 0;
+   fd->WriteEnd = 0;
+   fd->AppendClusters = 0;
 
    uint32_t lba = FAT_ClusterToLba(fd->CurrentCluster);
 
    if (!Partition_ReadSectors(disk, lba, 1, fd->Buffer))
    {
-      printf("FAT: open entry failed - read error cluster=%u lba=%u\n",
-             fd->CurrentCluster, lba);
-      printf("     file: ");
-      for (int i = 0; i < 11; i++) printf("%c", entry->Name[i]);
-      printf("\n");
-      printf("     Note: ATA driver may not be working in kernel mode\n");
+      if (TRACE_ENABLED(FAT, TRACE_LEVEL_ERROR))
+      {
+         printf("FAT: open entry failed - read error cluster=%u lba=%u\n",
+                fd->CurrentCluster, lba);
+         printf("     file: ");
+         for (int i = 0; i < 11; i++) printf("%c", entry->Name[i]);
+         printf("\n");
+         printf("     Note: ATA driver may not be working in kernel mode\n");
+      }
       // For now, just mark as opened with empty buffer to avoid crash
       // Real fix: implement working ATA driver in kernel
-      fd->Opened = true;
       fd->Public.Size = 0; // Mark as empty to prevent further reads
       return &fd->Public;
    }
 
-   fd->Opened = true;
    return &fd->Public;
 }
 
 uint32_t FAT_NextCluster(Partition *disk, uint32_t currentCluster)
 {
-   uint32_t fatIndex;
+   uint32_t fatIndex = FAT_EntryOffset(currentCluster);
 
-   if (g_FatType == 12)
-      fatIndex = currentCluster * 3 / 2;
-   else if (g_FatType == 16)
-      fatIndex = currentCluster * 2;
-   else if (g_FatType == 32)
-      fatIndex = currentCluster * 4;
+   if (g_Data->FatTable)
+      return FAT_DecodeEntry(g_Data->FatTable + fatIndex, currentCluster);
 
    uint32_t fatIndexSector = fatIndex / SECTOR_SIZE;
    if (fatIndexSector < g_Data->FatCachePos ||
@@ -472,48 +1299,223 @@ uint32_t FAT_NextCluster(Partition *disk, uint32_t currentCluster)
    }
 
    fatIndex -= (g_Data->FatCachePos * SECTOR_SIZE);
-   uint32_t nextCluster;
-   if (g_FatType == 12)
+   return FAT_DecodeEntry(g_Data->FatCache + fatIndex, currentCluster);
+}
+
+// Resolve cluster number `index` of a file's chain to its disk cluster.
+// Returns how many of the `count` clusters starting there are physically
+// contiguous on disk, or 0 if the chain ends before `index`. The extent list
+// is extended along the chain on demand and searched by binary search, so
+// repeated lookups cost no FAT accesses. Once the list is full, clusters
+// beyond it are found by walking the chain from its last extent.
+static uint32_t FAT_MapClusters(Partition *disk, FAT_FileData *fd,
+                                uint32_t index, uint32_t count,
+                                uint32_t *cluster)
+{
+   FAT_Node *node = fd->Node;
+   if (node->ExtentCount == 0)
+   {
+      if (!FAT_IsDataCluster(fd->FirstCluster)) return 0;
+      node->Extents[0].FileCluster = 0;
+      node->Extents[0].DiskCluster = fd->FirstCluster;
+      node->Extents[0].Length = 1;
+      node->ExtentCount = 1;
+   }
+
+   FAT_Extent *last = &node->Extents[node->ExtentCount - 1];
+   uint32_t lastCluster = last->DiskCluster + last->Length - 1;
+   uint32_t covered = last->FileCluster + last->Length;
+   while (covered < index + count)
    {
-      if (currentCluster % 2 == 0)
-         nextCluster = (*(uint16_t *)(g_Data->FatCache + fatIndex)) & 0x0fff;
+      uint32_t next = FAT_NextCluster(disk, lastCluster);
+      if (!FAT_IsDataCluster(next)) break;
+
+      if (next == lastCluster + 1)
+      {
+         last->Length++;
+      }
+      else if (node->ExtentCount < FAT_MAX_EXTENTS)
+      {
+         last = &node->Extents[node->ExtentCount++];
+         last->FileCluster = covered;
+         last->DiskCluster = next;
+         last->Length = 1;
+      }
       else
-         nextCluster = (*(uint16_t *)(g_Data->FatCache + fatIndex)) >> 4;
+      {
+         if (index < covered) break;
+
+         // Out of extents: walk the remaining distance uncached
+         for (uint32_t i = covered; i < index; i++)
+         {
+            next = FAT_NextCluster(disk, next);
+            if (!FAT_IsDataCluster(next)) return 0;
+         }
+         *cluster = next;
+         return 1;
+      }
 
-      if (nextCluster >= 0xff8)
+      lastCluster = next;
+      covered++;
+   }
+
+   if (index >= covered) return 0;
+
+   // Last extent starting at or before index
+   uint32_t lo = 0, hi = node->ExtentCount - 1;
+   while (lo < hi)
+   {
+      uint32_t mid = (lo + hi + 1) / 2;
+      if (node->Extents[mid].FileCluster <= index)
+         lo = mid;
+      else
+         hi = mid - 1;
+   }
+
+   FAT_Extent *extent = &node->Extents[lo];
+   uint32_t offset = index - extent->FileCluster;
+   *cluster = extent->DiskCluster + offset;
+   return min(count, extent->Length - offset);
+}
+
+// Prefetch the next window of clusters of a sequentially read file into the
+// block cache, starting after the clusters already prefetched. Physically
+// adjacent clusters are loaded with a single request. The window doubles
+// with every round, up to FAT_READAHEAD_MAX_SECTORS.
+static void FAT_ReadAhead(Partition *disk, FAT_FileData *fd)
+{
+   uint32_t sectorsPerCluster = g_Data->BS.BootSector.SectorsPerCluster;
+   uint32_t maxClusters = FAT_READAHEAD_MAX_SECTORS / sectorsPerCluster;
+   if (maxClusters == 0) maxClusters = 1;
+
+   uint32_t index = fd->Public.Position / (sectorsPerCluster * SECTOR_SIZE) +
+                    fd->ReadAheadClusters;
+   uint32_t fetched = 0;
+   while (fetched < fd->ReadAheadWindow)
+   {
+      uint32_t cluster;
+      uint32_t run = FAT_MapClusters(disk, fd, index + fetched,
+                                     fd->ReadAheadWindow - fetched, &cluster);
+      if (run == 0) break;
+
+      Partition_PrefetchSectors(disk, FAT_ClusterToLba(cluster),
+                                run * sectorsPerCluster);
+      fetched += run;
+   }
+
+   fd->ReadAheadClusters += fetched;
+   fd->ReadAheadWindow = min(fd->ReadAheadWindow * 2, maxClusters);
+}
+
+// Called when a sequential reader enters a new cluster: start the next
+// read-ahead round once half of the previous one has been consumed.
+static void FAT_ReadAheadAdvance(Partition *disk, FAT_FileData *fd)
+{
+   if (fd->ReadAheadWindow == 0) return;
+   if (fd->ReadAheadClusters > 0) fd->ReadAheadClusters--;
+   if (fd->ReadAheadClusters <= fd->ReadAheadWindow / 2)
+      FAT_ReadAhead(disk, fd);
+}
+
+// Move a regular file to its next sector, following the cluster chain, and
+// load that sector into fd->Buffer. Returns false at end of chain or on a
+// read error.
+static bool FAT_AdvanceSector(Partition *disk, FAT_FileData *fd)
+{
+   if (++fd->CurrentSectorInCluster >= g_Data->BS.BootSector.SectorsPerCluster)
+   {
+      fd->CurrentSectorInCluster = 0;
+      uint32_t next = FAT_NextCluster(disk, fd->CurrentCluster);
+
+      // Treat 0 (free) or invalid as EOF to avoid looping into free space
+      if (next < 2)
       {
-         nextCluster |= 0xfffff000;
+         fd->Public.Size = fd->Public.Position;
+         return false;
       }
+
+      fd->CurrentCluster = next;
+      FAT_ReadAheadAdvance(disk, fd);
    }
-   else if (g_FatType == 16)
+
+   // Check for end-of-chain based on FAT type
+   if (!FAT_IsDataCluster(fd->CurrentCluster))
    {
-      nextCluster = *(uint16_t *)(g_Data->FatCache + fatIndex);
-      if (nextCluster >= 0xfff8) nextCluster |= 0xffff0000;
+      // Mark end of file
+      fd->Public.Size = fd->Public.Position;
+      return false;
    }
-   else if (g_FatType == 32)
+
+   // read next sector
+   if (!Partition_ReadSectors(disk,
+                              FAT_ClusterToLba(fd->CurrentCluster) +
+                                  fd->CurrentSectorInCluster,
+                              1, fd->Buffer))
    {
-      uint32_t raw = *(uint32_t *)(g_Data->FatCache + fatIndex);
-      nextCluster = raw & 0x0FFFFFFF;
+      TRACE_ERROR(FAT, "FAT: read error!\n");
+      g_Data->ReadErrors++;
+      return false;
    }
-   return nextCluster;
+   return true;
+}
+
+// Read up to maxSectors whole sectors of a regular file, starting at the
+// current sector, straight into the caller's buffer. Only the physically
+// contiguous run of clusters starting at the current one is transferred, as
+// one request. On return the file is positioned on the last sector read.
+// Returns the number of sectors read, 0 on error.
+static uint32_t FAT_ReadDirect(Partition *disk, FAT_FileData *fd,
+                               uint8_t *dataOut, uint32_t maxSectors)
+{
+   uint32_t sectorsPerCluster = g_Data->BS.BootSector.SectorsPerCluster;
+   uint32_t index =
+       fd->Public.Position / (sectorsPerCluster * SECTOR_SIZE);
+   uint32_t wanted = (fd->CurrentSectorInCluster + maxSectors +
+                      sectorsPerCluster - 1) /
+                     sectorsPerCluster;
+
+   uint32_t cluster;
+   uint32_t run = FAT_MapClusters(disk, fd, index, wanted, &cluster);
+   if (run == 0) return 0;
+
+   uint32_t sectors =
+       min(maxSectors, run * sectorsPerCluster - fd->CurrentSectorInCluster);
+   if (!Partition_ReadSectors(disk,
+                              FAT_ClusterToLba(cluster) +
+                                  fd->CurrentSectorInCluster,
+                              sectors, dataOut))
+   {
+      TRACE_ERROR(FAT, "FAT: read error!\n");
+      g_Data->ReadErrors++;
+      return 0;
+   }
+
+   uint32_t last = fd->CurrentSectorInCluster + sectors - 1;
+   uint32_t clusters = last / sectorsPerCluster;
+
+   // Clusters crossed here no longer need reading ahead
+   fd->ReadAheadClusters -= min(fd->ReadAheadClusters, clusters);
+   fd->CurrentCluster = cluster + clusters;
+   fd->CurrentSectorInCluster = last % sectorsPerCluster;
+   return sectors;
 }
 
 uint32_t FAT_Read(Partition *disk, FAT_File *file, uint32_t byteCount,
                   void *dataOut)
 {
    // get file data
-   FAT_FileData *fd = (file->Handle == ROOT_DIRECTORY_HANDLE)
-                          ? &g_Data->RootDirectory
-                          : &g_Data->OpenedFiles[file->Handle];
+   FAT_FileData *fd = FAT_GetData(file);
+   if (!fd) return 0;
+   FAT_RefreshHandle(disk, fd);
 
    uint8_t *u8DataOut = (uint8_t *)dataOut;
 
    // For regular files (not directories), don't read empty files
    if (fd->Public.Size == 0 && !fd->Public.IsDirectory)
    {
-      printf("FAT_Read: file is empty (Size=0), returning 0 bytes, "
-             "IsDirectory=%u\n",
-             fd->Public.IsDirectory);
+      TRACE_DEBUG(FAT, "FAT_Read: file is empty (Size=0), returning 0 bytes, "
+                  "IsDirectory=%u\n",
+                  fd->Public.IsDirectory);
       return 0;
    }
 
@@ -533,8 +1535,46 @@ uint32_t FAT_Read(Partition *disk, FAT_File *file, uint32_t byteCount,
       }
    }
 
+   // Sequential access: this read continues where the previous one stopped.
+   // Anything else (seeks, interleaved writes) resets the read-ahead state.
+   bool regular =
+       fd->Public.Handle != ROOT_DIRECTORY_HANDLE && !fd->Public.IsDirectory;
+   uint32_t clusterBytes =
+       g_Data->BS.BootSector.SectorsPerCluster * SECTOR_SIZE;
+   if (!regular || fd->Public.Position != fd->ReadEnd)
+   {
+      fd->ReadAheadWindow = 0;
+      fd->ReadAheadClusters = 0;
+   }
+   else if (fd->ReadAheadWindow == 0)
+   {
+      // First sequential read: pull in the rest of the current cluster (and
+      // the next one) instead of single sectors. Requests spanning a whole
+      // cluster are read directly below and need no prefetch yet.
+      fd->ReadAheadWindow = 2;
+      if (byteCount < clusterBytes) FAT_ReadAhead(disk, fd);
+   }
+
    while (byteCount > 0)
    {
+      // Whole sectors of a regular file bypass fd->Buffer and are read
+      // straight into the caller's buffer, one request per contiguous run
+      if (regular && fd->Public.Position % SECTOR_SIZE == 0 &&
+          byteCount >= SECTOR_SIZE)
+      {
+         uint32_t sectors =
+             FAT_ReadDirect(disk, fd, u8DataOut, byteCount / SECTOR_SIZE);
+         if (sectors == 0) break;
+
+         u8DataOut += sectors * SECTOR_SIZE;
+         fd->Public.Position += sectors * SECTOR_SIZE;
+         byteCount -= sectors * SECTOR_SIZE;
+
+         // Keep fd->Buffer holding the sector at the new position
+         if (!FAT_AdvanceSector(disk, fd)) break;
+         continue;
+      }
+
       uint32_t leftInBuffer = SECTOR_SIZE - (fd->Public.Position % SECTOR_SIZE);
       uint32_t take = min(byteCount, leftInBuffer);
 
@@ -549,14 +1589,6 @@ uint32_t FAT_Read(Partition *disk, FAT_File *file, uint32_t byteCount,
       if (leftInBuffer == take ||
           (fd->Public.Position > 0 && fd->Public.Position % SECTOR_SIZE == 0))
       {
-         // Prevent infinite loops - safety check
-         static uint32_t loop_counter = 0;
-         if (++loop_counter > 1000)
-         {
-            printf("FAT_Read: infinite loop detected, breaking\n");
-            loop_counter = 0;
-            break;
-         }
          // Special handling for root directory
          if (fd->Public.Handle == ROOT_DIRECTORY_HANDLE)
          {
@@ -594,7 +1626,8 @@ uint32_t FAT_Read(Partition *disk, FAT_File *file, uint32_t byteCount,
                                               fd->CurrentSectorInCluster,
                                           1, fd->Buffer))
                {
-                  printf("FAT: read error!\n");
+                  TRACE_ERROR(FAT, "FAT: read error!\n");
+                  g_Data->ReadErrors++;
                   break;
                }
             }
@@ -612,55 +1645,20 @@ uint32_t FAT_Read(Partition *disk, FAT_File *file, uint32_t byteCount,
                if (!Partition_ReadSectors(disk, fd->CurrentCluster, 1,
                                           fd->Buffer))
                {
-                  printf("FAT: read error!\n");
+                  TRACE_ERROR(FAT, "FAT: read error!\n");
+                  g_Data->ReadErrors++;
                   break;
                }
             }
          }
-         else
+         else if (!FAT_AdvanceSector(disk, fd))
          {
-            // calculate next cluster & sector to read
-            if (++fd->CurrentSectorInCluster >=
-                g_Data->BS.BootSector.SectorsPerCluster)
-            {
-               fd->CurrentSectorInCluster = 0;
-               uint32_t next = FAT_NextCluster(disk, fd->CurrentCluster);
-
-               // Treat 0 (free) or invalid as EOF to avoid looping into free
-               // space
-               if (next < 2)
-               {
-                  fd->Public.Size = fd->Public.Position;
-                  break;
-               }
-
-               fd->CurrentCluster = next;
-            }
-
-            // Check for end-of-chain based on FAT type
-            uint32_t eofMarker = (g_FatType == 12)   ? 0xFF8
-                                 : (g_FatType == 16) ? 0xFFF8
-                                                     : 0x0FFFFFF8;
-            if (fd->CurrentCluster >= eofMarker)
-            {
-               // Mark end of file
-               fd->Public.Size = fd->Public.Position;
-               break;
-            }
-
-            // read next sector
-            if (!Partition_ReadSectors(disk,
-                                       FAT_ClusterToLba(fd->CurrentCluster) +
-                                           fd->CurrentSectorInCluster,
-                                       1, fd->Buffer))
-            {
-               printf("FAT: read error!\n");
-               break;
-            }
+            break;
          }
       }
    }
 
+   fd->ReadEnd = fd->Public.Position;
    return u8DataOut - (uint8_t *)dataOut;
 }
 
@@ -672,6 +1670,41 @@ bool FAT_ReadEntry(Partition *disk, FAT_File *file,
    return bytes_read == sizeof(FAT_DirectoryEntry);
 }
 
+// Give back the clusters of a file's chain beyond its size, reserved by
+// FAT_Allocate or grown ahead by a streaming writer. The first cluster is
+// always kept.
+static void FAT_TrimChain(Partition *disk, FAT_Node *node)
+{
+   uint32_t clusterBytes =
+       g_Data->BS.BootSector.SectorsPerCluster * SECTOR_SIZE;
+   uint32_t keep = node->Size / clusterBytes + (node->Size % clusterBytes != 0);
+
+   uint32_t last = node->FirstCluster;
+   for (uint32_t i = 1; i < keep; i++)
+   {
+      last = FAT_NextCluster(disk, last);
+      if (!FAT_IsDataCluster(last)) return;
+   }
+
+   uint32_t next = FAT_NextCluster(disk, last);
+   if (!FAT_IsDataCluster(next)) return;
+
+   uint32_t eofVal = (g_FatType == 12)   ? 0x0FFF
+                     : (g_FatType == 16) ? 0xFFFF
+                                         : 0x0FFFFFFF;
+   if (!FAT_WriteFatEntry(disk, last, eofVal)) return;
+   while (FAT_IsDataCluster(next))
+   {
+      uint32_t after = FAT_NextCluster(disk, next);
+      if (!FAT_WriteFatEntry(disk, next, 0)) break;
+      next = after;
+   }
+
+   node->ExtentCount = 0;
+   node->Preallocated = false;
+   FAT_FlushFat(disk);
+}
+
 void FAT_Close(FAT_File *file)
 {
    if (file->Handle == ROOT_DIRECTORY_HANDLE)
@@ -681,29 +1714,57 @@ void FAT_Close(FAT_File *file)
    }
    else
    {
-      g_Data->OpenedFiles[file->Handle].Opened = false;
+      FAT_FileData *fd = FAT_GetData(file);
+      if (!fd) return;
+      g_Data->Handles[file->Handle] = NULL;
+
+      // The last handle gives back what was reserved past the end
+      FAT_Node *node = fd->Node;
+      if (node->RefCount == 1 && node->Preallocated && node->Hashed &&
+          g_Data->Disk)
+         FAT_TrimChain(g_Data->Disk, node);
+      FAT_NodePut(node);
+      free(fd);
    }
+
+   // Closing is the durability point: the FAT, FSInfo and the writes held
+   // in the block cache all go out here
+   if (g_Data->Disk)
+      FAT_Sync(g_Data->Disk);
+   else
+      BCache_Sync();
 }
 
-bool FAT_FindFile(Partition *disk, FAT_File *file, const char *name,
-                  FAT_DirectoryEntry *entryOut)
+bool FAT_Sync(Partition *disk)
 {
-   // Reject paths; this helper expects a single 8.3 component
-   if (strchr(name, '/'))
+   bool ok = FAT_FlushFat(disk);
+   if (!FAT_FlushFSInfo(disk)) ok = false;
+   return BCache_Sync() && ok;
+}
+
+void FAT_GetUsage(Partition *disk, uint32_t *totalSectors,
+                  uint32_t *freeSectors)
+{
+   // Without FSInfo or the in-memory table, count free entries once
+   if (g_Data->FreeClusters == FAT_FREE_UNKNOWN)
    {
-      printf("FAT_FindFile: received path '%s', expected single component\n",
-             name);
-      return false;
+      uint32_t freeClusters = 0;
+      for (uint32_t cluster = 2; cluster < g_ClusterCount; cluster++)
+         if (FAT_NextCluster(disk, cluster) == 0) freeClusters++;
+      g_Data->FreeClusters = freeClusters;
+      g_Data->FreeExact = true;
+      g_Data->FSInfoDirty = true;
    }
 
-   char fatName[12];
-   FAT_DirectoryEntry entry;
-
-   // Reset directory position to start searching from the beginning
-   FAT_Seek(disk, file, 0);
+   uint32_t sectorsPerCluster = g_Data->BS.BootSector.SectorsPerCluster;
+   *totalSectors = (g_ClusterCount - 2) * sectorsPerCluster;
+   *freeSectors = g_Data->FreeClusters * sectorsPerCluster;
+}
 
-   // convert from name to fat name
-   memset(fatName, ' ', sizeof(fatName));
+// Convert a single path component to a space padded 8.3 name
+static void FAT_ToFatName(const char *name, char fatName[12])
+{
+   memset(fatName, ' ', 12);
    fatName[11] = '\0';
 
    const char *ext = strchr(name, '.');
@@ -722,23 +1783,142 @@ bool FAT_FindFile(Partition *disk, FAT_File *file, const char *name,
       for (int i = 0; i < 3 && ext[i + 1]; i++)
          fatName[i + 8] = toupper(ext[i + 1]);
    }
+}
+
+// Dentry cache key of an open directory
+static uint32_t FAT_DirectoryKey(FAT_FileData *dir)
+{
+   return (dir == &g_Data->RootDirectory) ? 0 : dir->FirstCluster;
+}
+
+static FAT_Dentry *FAT_DentryBucket(uint32_t directory, const char *fatName)
+{
+   // FNV-1a over the directory key and the 8.3 name
+   uint32_t hash = 2166136261u;
+   for (int i = 0; i < 4; i++)
+      hash = (hash ^ ((directory >> (i * 8)) & 0xFF)) * 16777619u;
+   for (int i = 0; i < 11; i++) hash = (hash ^ (uint8_t)fatName[i]) * 16777619u;
+   return g_Data->Dentries[hash % FAT_DENTRY_BUCKETS];
+}
+
+static FAT_Dentry *FAT_DentryFind(uint32_t directory, const char *fatName)
+{
+   FAT_Dentry *bucket = FAT_DentryBucket(directory, fatName);
+   for (int i = 0; i < FAT_DENTRY_WAYS; i++)
+   {
+      FAT_Dentry *d = &bucket[i];
+      if (d->Valid && d->Directory == directory &&
+          memcmp(d->Name, fatName, 11) == 0)
+      {
+         d->LastUsed = ++g_Data->DentryClock;
+         return d;
+      }
+   }
+   return NULL;
+}
+
+// Remember the result of a lookup; entry is NULL for a name that does not
+// exist. Replaces the least recently used entry of the bucket.
+static void FAT_DentryInsert(uint32_t directory, const char *fatName,
+                             const FAT_DirectoryEntry *entry)
+{
+   FAT_Dentry *bucket = FAT_DentryBucket(directory, fatName);
+   FAT_Dentry *victim = &bucket[0];
+   for (int i = 0; i < FAT_DENTRY_WAYS; i++)
+   {
+      FAT_Dentry *d = &bucket[i];
+      if (d->Valid && d->Directory == directory &&
+          memcmp(d->Name, fatName, 11) == 0)
+      {
+         victim = d;
+         break;
+      }
+      if (!d->Valid || (victim->Valid && d->LastUsed < victim->LastUsed))
+         victim = d;
+   }
+
+   victim->Valid = true;
+   victim->Negative = (entry == NULL);
+   victim->Directory = directory;
+   memcpy(victim->Name, fatName, 11);
+   victim->LastUsed = ++g_Data->DentryClock;
+   if (entry) victim->Entry = *entry;
+}
+
+static void FAT_DentryInvalidate(uint32_t directory, const char *fatName)
+{
+   FAT_Dentry *d = FAT_DentryFind(directory, fatName);
+   if (d) d->Valid = false;
+}
+
+// Drop everything cached about the contents of a directory
+static void FAT_DentryInvalidateDirectory(uint32_t directory)
+{
+   for (int b = 0; b < FAT_DENTRY_BUCKETS; b++)
+      for (int i = 0; i < FAT_DENTRY_WAYS; i++)
+         if (g_Data->Dentries[b][i].Directory == directory)
+            g_Data->Dentries[b][i].Valid = false;
+}
+
+bool FAT_FindFile(Partition *disk, FAT_File *file, const char *name,
+                  FAT_DirectoryEntry *entryOut)
+{
+   // Reject paths; this helper expects a single 8.3 component
+   if (strchr(name, '/'))
+   {
+      TRACE_ERROR(FAT, "FAT_FindFile: received path '%s', expected single "
+                  "component\n",
+                  name);
+      return false;
+   }
+
+   FAT_FileData *fd = FAT_GetData(file);
+   if (!fd) return false;
+   uint32_t directory = FAT_DirectoryKey(fd);
+
+   char fatName[12];
+   FAT_ToFatName(name, fatName);
+
+   FAT_Dentry *cached = FAT_DentryFind(directory, fatName);
+   if (cached)
+   {
+      if (cached->Negative) return false;
+      *entryOut = cached->Entry;
+      return true;
+   }
+
+   // Reset directory position to start searching from the beginning
+   uint32_t readErrors = g_Data->ReadErrors;
+   if (!FAT_Seek(disk, file, 0)) return false;
 
+   FAT_DirectoryEntry entry;
+   bool ended = false;
    while (FAT_ReadEntry(disk, file, &entry))
    {
       // FAT end marker: empty entry means end of directory
-      if (entry.Name[0] == 0x00) break;
+      if (entry.Name[0] == 0x00)
+      {
+         ended = true;
+         break;
+      }
 
       // Skip LFN entries (attribute 0x0F)
       if ((entry.Attributes & 0x0F) == 0x0F) continue;
 
       if (memcmp(fatName, entry.Name, 11) == 0)
       {
-         uint32_t cluster =
-             entry.FirstClusterLow + ((uint32_t)entry.FirstClusterHigh << 16);
+         FAT_DentryInsert(directory, fatName, &entry);
          *entryOut = entry;
          return true;
       }
    }
+
+   // Remember the miss only if the whole directory was read without errors.
+   // FAT_Read ends a directory at the end of its chain by setting Size to the
+   // position; a failed read must not be cached as "does not exist".
+   if (fd->Public.Position == fd->Public.Size) ended = true;
+   if (ended && g_Data->ReadErrors == readErrors)
+      FAT_DentryInsert(directory, fatName, NULL);
    return false;
 }
 
@@ -752,8 +1932,13 @@ FAT_File *FAT_Open(Partition *disk, const char *path)
    // If path is empty or just "/", return root directory
    if (path[0] == '\0') return &g_Data->RootDirectory.Public;
 
-   FAT_File *current = &g_Data->RootDirectory.Public;
-   FAT_File *previous = NULL;
+   // Walk the path through the dentry cache. Intermediate directories are
+   // only opened when a lookup misses and they have to be scanned.
+   FAT_FileData *root = &g_Data->RootDirectory;
+   FAT_DirectoryEntry directory; // Current directory, unless inRoot
+   bool inRoot = true;
+   uint32_t parentCluster = root->FirstCluster; // Directory holding it
+   bool parentIsRoot = true;
 
    while (*path)
    {
@@ -777,51 +1962,66 @@ FAT_File *FAT_Open(Partition *disk, const char *path)
 
       // find directory entry in current directory
       FAT_DirectoryEntry entry;
-      if (FAT_FindFile(disk, current, name, &entry))
+      bool found;
+      char fatName[12];
+      FAT_ToFatName(name, fatName);
+      FAT_Dentry *cached = FAT_DentryFind(
+          inRoot ? 0 : FAT_EntryCluster(&directory), fatName);
+      if (cached)
       {
-         // Close previous directory (but not root if it's the current one)
-         if (previous != NULL && previous->Handle != ROOT_DIRECTORY_HANDLE)
-         {
-            FAT_Close(previous);
-         }
-
-         // check if directory
-         if (!isLast && (entry.Attributes & FAT_ATTRIBUTE_DIRECTORY) == 0)
-         {
-            printf("FAT: %s not a directory\n", name);
-            return NULL;
-         }
-
-         // open new directory entry
-         previous = current;
-
-         // Determine parent file data so we can record it on the opened entry
-         FAT_FileData *parentData = (current->Handle == ROOT_DIRECTORY_HANDLE)
-                                        ? &g_Data->RootDirectory
-                                        : &g_Data->OpenedFiles[current->Handle];
-
-         current = FAT_OpenEntry(disk, &entry, parentData);
+         found = !cached->Negative;
+         if (found) entry = cached->Entry;
+      }
+      else if (inRoot)
+      {
+         found = FAT_FindFile(disk, &root->Public, name, &entry);
       }
       else
       {
-         // Close previous directory (but not root)
-         if (previous != NULL && previous->Handle != ROOT_DIRECTORY_HANDLE)
-         {
-            FAT_Close(previous);
-         }
+         FAT_File *dir =
+             FAT_OpenEntry(disk, &directory, parentCluster, parentIsRoot);
+         if (!dir) return NULL;
+         found = FAT_FindFile(disk, dir, name, &entry);
+         FAT_Close(dir);
+      }
+
+      if (!found)
+      {
+         TRACE_DEBUG(FAT, "FAT: %s not found\n", name);
+         return NULL;
+      }
 
-         printf("FAT: %s not found\n", name);
+      // check if directory
+      if (!isLast && (entry.Attributes & FAT_ATTRIBUTE_DIRECTORY) == 0)
+      {
+         TRACE_DEBUG(FAT, "FAT: %s not a directory\n", name);
          return NULL;
       }
+
+      if (isLast)
+         return FAT_OpenEntry(disk, &entry,
+                              inRoot ? root->FirstCluster
+                                     : FAT_EntryCluster(&directory),
+                              inRoot);
+
+      // descend; a ".." entry pointing at cluster 0 leads back to the root
+      parentCluster =
+          inRoot ? root->FirstCluster : FAT_EntryCluster(&directory);
+      parentIsRoot = inRoot;
+      directory = entry;
+      inRoot = (FAT_EntryCluster(&entry) == 0);
    }
-   return current;
+
+   // path ended with a slash: open the directory itself
+   if (inRoot) return &root->Public;
+   return FAT_OpenEntry(disk, &directory, parentCluster, parentIsRoot);
 }
 
 bool FAT_Seek(Partition *disk, FAT_File *file, uint32_t position)
 {
-   FAT_FileData *fd = (file->Handle == ROOT_DIRECTORY_HANDLE)
-                          ? &g_Data->RootDirectory
-                          : &g_Data->OpenedFiles[file->Handle];
+   FAT_FileData *fd = FAT_GetData(file);
+   if (!fd) return false;
+   FAT_RefreshHandle(disk, fd);
 
    // don't seek past end (but allow seeks in directories since they don't track
    // size)
@@ -836,9 +2036,9 @@ bool FAT_Seek(Partition *disk, FAT_File *file, uint32_t position)
    // Guard against divide-by-zero from invalid FAT parameters
    if (bytesPerSector == 0 || sectorsPerCluster == 0)
    {
-      printf("FAT_Seek: invalid FAT parameters (BytesPerSector=%u, "
-             "SectorsPerCluster=%u)\n",
-             bytesPerSector, sectorsPerCluster);
+      TRACE_ERROR(FAT, "FAT_Seek: invalid FAT parameters (BytesPerSector=%u, "
+                  "SectorsPerCluster=%u)\n",
+                  bytesPerSector, sectorsPerCluster);
       return false;
    }
 
@@ -852,16 +2052,11 @@ bool FAT_Seek(Partition *disk, FAT_File *file, uint32_t position)
          uint32_t clusterIndex = position / clusterBytes;
          uint32_t sectorInCluster = (position % clusterBytes) / bytesPerSector;
 
-         uint32_t cluster = fd->FirstCluster;
-         for (uint32_t i = 0; i < clusterIndex; i++)
+         uint32_t cluster;
+         if (FAT_MapClusters(disk, fd, clusterIndex, 1, &cluster) == 0)
          {
-            cluster = FAT_NextCluster(disk, cluster);
-            uint32_t eofMarker = 0xFFFFFFF8;
-            if (cluster >= eofMarker)
-            {
-               fd->Public.Size = fd->Public.Position;
-               return false;
-            }
+            fd->Public.Size = fd->Public.Position;
+            return false;
          }
 
          fd->CurrentCluster = cluster;
@@ -872,7 +2067,7 @@ bool FAT_Seek(Partition *disk, FAT_File *file, uint32_t position)
                                         fd->CurrentSectorInCluster,
                                     1, fd->Buffer))
          {
-            printf("FAT: seek read error (root)\n");
+            TRACE_ERROR(FAT, "FAT: seek read error (root)\n");
             return false;
          }
       }
@@ -885,7 +2080,7 @@ bool FAT_Seek(Partition *disk, FAT_File *file, uint32_t position)
 
          if (!Partition_ReadSectors(disk, fd->CurrentCluster, 1, fd->Buffer))
          {
-            printf("FAT: seek read error (root)\n");
+            TRACE_ERROR(FAT, "FAT: seek read error (root)\n");
             return false;
          }
       }
@@ -895,27 +2090,20 @@ bool FAT_Seek(Partition *disk, FAT_File *file, uint32_t position)
       // Guard: don't try to seek on regular files that are empty
       if (fd->Public.Size == 0 && !fd->Public.IsDirectory)
       {
-         printf("FAT_Seek: cannot seek on empty regular file\n");
+         TRACE_ERROR(FAT, "FAT_Seek: cannot seek on empty regular file\n");
          return false;
       }
 
       uint32_t clusterIndex = position / clusterBytes;
       uint32_t sectorInCluster = (position % clusterBytes) / bytesPerSector;
 
-      // walk cluster chain clusterIndex times from first cluster
-      uint32_t c = fd->FirstCluster;
-      for (uint32_t i = 0; i < clusterIndex; i++)
+      // look the cluster up in the file's extent list
+      uint32_t c;
+      if (FAT_MapClusters(disk, fd, clusterIndex, 1, &c) == 0)
       {
-         c = FAT_NextCluster(disk, c);
-         uint32_t eofMarker = (g_FatType == 12)   ? 0xFF8
-                              : (g_FatType == 16) ? 0xFFF8
-                                                  : 0x0FFFFFF8;
-         if (c >= eofMarker)
-         {
-            // invalid / end of chain
-            fd->Public.Size = fd->Public.Position;
-            return false;
-         }
+         // invalid / end of chain
+         fd->Public.Size = fd->Public.Position;
+         return false;
       }
 
       fd->CurrentCluster = c;
@@ -926,7 +2114,7 @@ bool FAT_Seek(Partition *disk, FAT_File *file, uint32_t position)
                                      fd->CurrentSectorInCluster,
                                  1, fd->Buffer))
       {
-         printf("FAT: seek read error (file)\n");
+         TRACE_ERROR(FAT, "FAT: seek read error (file)\n");
          return false;
       }
    }
@@ -940,19 +2128,13 @@ bool FAT_WriteEntry(Partition *disk, FAT_File *file,
    // Allow writing into root directory as well as opened directory files.
    if (!file) return false;
 
-   FAT_FileData *fd;
    bool isRoot = (file->Handle == ROOT_DIRECTORY_HANDLE);
-   if (isRoot)
-      fd = &g_Data->RootDirectory;
-   else
-   {
-      if (file->Handle < 0 || file->Handle >= MAX_FILE_HANDLES) return false;
-      fd = &g_Data->OpenedFiles[file->Handle];
-   }
+   FAT_FileData *fd = FAT_GetData(file);
+   if (!fd) return false;
 
    if (!file->IsDirectory)
    {
-      printf("FAT: WriteEntry called on non-directory file\n");
+      TRACE_ERROR(FAT, "FAT: WriteEntry called on non-directory file\n");
       return false;
    }
 
@@ -978,57 +2160,50 @@ bool FAT_WriteEntry(Partition *disk, FAT_File *file,
    uint8_t sectorBuffer[SECTOR_SIZE];
    if (!Partition_ReadSectors(disk, sectorLba, 1, sectorBuffer))
    {
-      printf("FAT: WriteEntry read error\n");
+      TRACE_ERROR(FAT, "FAT: WriteEntry read error\n");
       return false;
    }
 
    memcpy(&sectorBuffer[offsetInSector], dirEntry, sizeof(FAT_DirectoryEntry));
+   FAT_DentryInvalidate(FAT_DirectoryKey(fd), (const char *)dirEntry->Name);
 
-   printf("FAT_WriteEntry: writing entry '%s' at LBA=%u, offset=%u, "
-          "cluster=0x%x\n",
-          dirEntry->Name, sectorLba, offsetInSector,
-          dirEntry->FirstClusterLow |
-              ((uint32_t)dirEntry->FirstClusterHigh << 16));
+   TRACE_DEBUG(FAT, "FAT_WriteEntry: writing entry '%s' at LBA=%u, offset=%u, "
+               "cluster=0x%x\n",
+               dirEntry->Name, sectorLba, offsetInSector,
+               dirEntry->FirstClusterLow |
+                   ((uint32_t)dirEntry->FirstClusterHigh << 16));
 
    if (!Partition_WriteSectors(disk, sectorLba, 1, sectorBuffer))
    {
-      printf("FAT: WriteEntry write error\n");
+      TRACE_ERROR(FAT, "FAT: WriteEntry write error\n");
       return false;
    }
 
    // Update the file descriptor's buffer with the modified sector
    // so that subsequent reads see the updated entry
    memcpy(fd->Buffer, sectorBuffer, SECTOR_SIZE);
+   FAT_Touch(fd);
 
    // Advance position by one directory entry (bytes)
    file->Position += sizeof(FAT_DirectoryEntry);
    return true;
 }
 
-uint32_t FAT_Write(Partition *disk, FAT_File *file, uint32_t byteCount,
-                   const void *dataIn)
+static uint32_t FAT_WriteData(Partition *disk, FAT_File *file,
+                              uint32_t byteCount, const void *dataIn)
 {
-   // get file data
-   FAT_FileData *fd = (file->Handle == ROOT_DIRECTORY_HANDLE)
-                          ? &g_Data->RootDirectory
-                          : &g_Data->OpenedFiles[file->Handle];
-
    // Don't write to directories or root
    if (file->IsDirectory || file->Handle == ROOT_DIRECTORY_HANDLE)
    {
-      printf("FAT_Write: cannot write to directory\n");
-      return 0;
-   }
-
-   if (file->Handle < 0 || file->Handle >= MAX_FILE_HANDLES)
-   {
-      printf("FAT_Write: invalid file handle %d\n", file->Handle);
+      TRACE_ERROR(FAT, "FAT_Write: cannot write to directory\n");
       return 0;
    }
 
-   if (!fd->Opened)
+   // get file data
+   FAT_FileData *fd = FAT_GetData(file);
+   if (!fd)
    {
-      printf("FAT_Write: file not opened\n");
+      TRACE_ERROR(FAT, "FAT_Write: invalid file handle %d\n", file->Handle);
       return 0;
    }
 
@@ -1036,7 +2211,7 @@ uint32_t FAT_Write(Partition *disk, FAT_File *file, uint32_t byteCount,
    if (g_Data->BS.BootSector.BytesPerSector == 0 ||
        g_Data->BS.BootSector.SectorsPerCluster == 0)
    {
-      printf("FAT_Write: invalid BPB parameters\n");
+      TRACE_ERROR(FAT, "FAT_Write: invalid BPB parameters\n");
       return 0;
    }
 
@@ -1044,17 +2219,18 @@ uint32_t FAT_Write(Partition *disk, FAT_File *file, uint32_t byteCount,
    // data
    if (fd->Public.Size == 0 && fd->Public.Position == 0)
    {
-      printf("FAT_Write: clearing buffer for newly created file\n");
+      TRACE_DEBUG(FAT, "FAT_Write: clearing buffer for newly created file\n");
       memset(fd->Buffer, 0, SECTOR_SIZE);
    }
 
    const uint8_t *u8DataIn = (const uint8_t *)dataIn;
    uint32_t bytesWritten = 0;
 
-   printf("FAT_Write: START - Position=%u, Size=%u, CurrentCluster=%u, "
-          "CurrentSectorInCluster=%u, writing %u bytes\n",
-          fd->Public.Position, fd->Public.Size, fd->CurrentCluster,
-          fd->CurrentSectorInCluster, byteCount);
+   TRACE_DEBUG(FAT,
+               "FAT_Write: START - Position=%u, Size=%u, CurrentCluster=%u, "
+               "CurrentSectorInCluster=%u, writing %u bytes\n",
+               fd->Public.Position, fd->Public.Size, fd->CurrentCluster,
+               fd->CurrentSectorInCluster, byteCount);
 
    while (byteCount > 0)
    {
@@ -1083,14 +2259,15 @@ uint32_t FAT_Write(Partition *disk, FAT_File *file, uint32_t byteCount,
              FAT_ClusterToLba(fd->CurrentCluster) + fd->CurrentSectorInCluster;
 
          // Debug each sector write
-         printf("FAT_Write: pos=%u, writing %u bytes to cluster=%u, "
-                "sectorInCluster=%u (LBA=%u)\n",
-                fd->Public.Position - take, take, fd->CurrentCluster,
-                fd->CurrentSectorInCluster, sectorLba);
+         TRACE_DEBUG(FAT, "FAT_Write: pos=%u, writing %u bytes to cluster=%u, "
+                     "sectorInCluster=%u (LBA=%u)\n",
+                     fd->Public.Position - take, take, fd->CurrentCluster,
+                     fd->CurrentSectorInCluster, sectorLba);
 
          if (!Partition_WriteSectors(disk, sectorLba, 1, fd->Buffer))
          {
-            printf("FAT_Write: sector write error at LBA %u\n", sectorLba);
+            TRACE_ERROR(FAT, "FAT_Write: sector write error at LBA %u\n",
+                        sectorLba);
             return bytesWritten;
          }
 
@@ -1120,58 +2297,33 @@ uint32_t FAT_Write(Partition *disk, FAT_File *file, uint32_t byteCount,
 
             if (nextCluster >= eofMarker)
             {
-               // Allocate new cluster
-               uint32_t newCluster = 0;
-               uint32_t maxClusters = (g_TotalSectors - g_DataSectionLba) /
-                                      g_Data->BS.BootSector.SectorsPerCluster;
-               uint32_t maxSearchClusters = maxClusters;
-
-               // Find free cluster
-               for (uint32_t testCluster = 2; testCluster < maxSearchClusters;
-                    testCluster++)
-               {
-                  if (FAT_NextCluster(disk, testCluster) == 0)
-                  {
-                     newCluster = testCluster;
-                     break;
-                  }
-               }
-
-               if (newCluster == 0)
-               {
-                  printf("FAT_Write: no free clusters available\n");
-                  return bytesWritten;
-               }
-
-               // Link current -> new and mark new as EOF across all FATs/cache
-               uint32_t eofVal = (g_FatType == 12)   ? 0x0FFF
-                                 : (g_FatType == 16) ? 0xFFFF
-                                                     : 0x0FFFFFFF;
-
-               if (!FAT_WriteFatEntry(disk, fd->CurrentCluster, newCluster) ||
-                   !FAT_WriteFatEntry(disk, newCluster, eofVal))
+               // Extend the chain right after this cluster. Streaming
+               // appends grow it by twice as much as the previous time, the
+               // excess is trimmed when the file is closed.
+               uint32_t maxGrow = FAT_PREALLOC_MAX_SECTORS /
+                                  g_Data->BS.BootSector.SectorsPerCluster;
+               uint32_t grow =
+                   fd->AppendClusters ? min(fd->AppendClusters * 2, maxGrow)
+                                      : 1;
+               if (grow == 0) grow = 1;
+
+               uint32_t newCluster;
+               uint32_t added =
+                   FAT_ExtendChain(disk, fd->CurrentCluster, grow, &newCluster);
+               if (added == 0)
                {
-                  printf(
-                      "FAT_Write: FAT write error linking/marking cluster\n");
+                  TRACE_ERROR(FAT, "FAT_Write: no free clusters available\n");
                   return bytesWritten;
                }
-
-               // Verify the EOF was actually written
-               uint32_t verify = FAT_NextCluster(disk, newCluster);
-               if (verify != eofVal)
-               {
-                  printf("FAT_Write: ERROR: linked %u->%u, marked %u as EOF "
-                         "(0x%08x), but verify=0x%08x\n",
-                         fd->CurrentCluster, newCluster, newCluster, eofVal,
-                         verify);
-               }
+               fd->AppendClusters = added;
+               if (added > 1) fd->Node->Preallocated = true;
 
                // Update current cluster and read it
                fd->CurrentCluster = newCluster;
                if (!Partition_ReadSectors(disk, FAT_ClusterToLba(newCluster), 1,
                                           fd->Buffer))
                {
-                  printf("FAT_Write: failed to read new cluster\n");
+                  TRACE_ERROR(FAT, "FAT_Write: failed to read new cluster\n");
                   return bytesWritten;
                }
             }
@@ -1183,7 +2335,7 @@ uint32_t FAT_Write(Partition *disk, FAT_File *file, uint32_t byteCount,
                                           FAT_ClusterToLba(fd->CurrentCluster),
                                           1, fd->Buffer))
                {
-                  printf("FAT_Write: failed to read next cluster\n");
+                  TRACE_ERROR(FAT, "FAT_Write: failed to read next cluster\n");
                   return bytesWritten;
                }
             }
@@ -1196,7 +2348,7 @@ uint32_t FAT_Write(Partition *disk, FAT_File *file, uint32_t byteCount,
                                            fd->CurrentSectorInCluster,
                                        1, fd->Buffer))
             {
-               printf("FAT_Write: failed to read next sector\n");
+               TRACE_ERROR(FAT, "FAT_Write: failed to read next sector\n");
                return bytesWritten;
             }
          }
@@ -1213,69 +2365,94 @@ uint32_t FAT_Write(Partition *disk, FAT_File *file, uint32_t byteCount,
    // position, and seeking would fail if the chain isn't long enough yet
    // (which is normal when appending data in multiple write calls).
 
-   // Verify the cluster chain integrity
-   uint32_t chainLength = 0;
-   uint32_t testCluster = fd->FirstCluster;
-   uint32_t eofMarker = (g_FatType == 12)   ? 0xFF8
-                        : (g_FatType == 16) ? 0xFFF8
-                                            : 0x0FFFFFF8;
-
-   printf("FAT_Write: verifying cluster chain starting from %u:\n",
-          testCluster);
-   while (testCluster < eofMarker && chainLength < 100)
+   // Verify the cluster chain integrity. This walks the whole chain on every
+   // write, so it only runs when the output is wanted.
+   if (TRACE_ENABLED(FAT, TRACE_LEVEL_DEBUG))
    {
-      uint32_t next = FAT_NextCluster(disk, testCluster);
-      printf("  [%u] cluster %u -> 0x%08x\n", chainLength, testCluster, next);
-      if (next >= eofMarker)
+      uint32_t chainLength = 0;
+      uint32_t testCluster = fd->FirstCluster;
+      uint32_t eofMarker = (g_FatType == 12)   ? 0xFF8
+                           : (g_FatType == 16) ? 0xFFF8
+                                               : 0x0FFFFFF8;
+
+      printf("FAT_Write: verifying cluster chain starting from %u:\n",
+             testCluster);
+      while (testCluster < eofMarker && chainLength < 100)
       {
+         uint32_t next = FAT_NextCluster(disk, testCluster);
+         printf("  [%u] cluster %u -> 0x%08x\n", chainLength, testCluster,
+                next);
+         if (next >= eofMarker)
+         {
+            chainLength++;
+            break;
+         }
+         testCluster = next;
          chainLength++;
-         break;
-      }
-      testCluster = next;
-      chainLength++;
 
-      if (next < 2)
-      {
-         printf("FAT_Write: ERROR - chain broken at cluster %u (next=%u)\n",
-                testCluster, next);
-         break;
+         if (next < 2)
+         {
+            printf("FAT_Write: ERROR - chain broken at cluster %u (next=%u)\n",
+                   testCluster, next);
+            break;
+         }
       }
+      printf("FAT_Write: chain length = %u clusters = %u bytes (expected %u "
+             "bytes)\n",
+             chainLength, chainLength * 512, fd->Public.Size);
    }
-   printf(
-       "FAT_Write: chain length = %u clusters = %u bytes (expected %u bytes)\n",
-       chainLength, chainLength * 512, fd->Public.Size);
 
-   printf("FAT_Write: wrote %u bytes, file now %u bytes\n", bytesWritten,
-          fd->Public.Size);
+   TRACE_DEBUG(FAT, "FAT_Write: wrote %u bytes, file now %u bytes\n",
+               bytesWritten, fd->Public.Size);
    return bytesWritten;
 }
 
+uint32_t FAT_Write(Partition *disk, FAT_File *file, uint32_t byteCount,
+                   const void *dataIn)
+{
+   FAT_FileData *fd = FAT_GetData(file);
+   if (fd)
+   {
+      FAT_RefreshHandle(disk, fd);
+      if (fd->Public.Position != fd->WriteEnd) fd->AppendClusters = 0;
+   }
+
+   uint32_t written = FAT_WriteData(disk, file, byteCount, dataIn);
+   if (written > 0) FAT_Touch(fd);
+   if (fd) fd->WriteEnd = fd->Public.Position;
+
+   // Chain changes of the whole write reach every FAT copy together
+   FAT_FlushFat(disk);
+   return written;
+}
+
 bool FAT_UpdateEntry(Partition *disk, FAT_File *file)
 {
    // Update the directory entry in the *parent* directory of this file.
    if (!file) return false;
 
-   FAT_FileData *fd = (file->Handle == ROOT_DIRECTORY_HANDLE)
-                          ? &g_Data->RootDirectory
-                          : &g_Data->OpenedFiles[file->Handle];
-
-   if (file->Handle != ROOT_DIRECTORY_HANDLE)
-   {
-      if (file->Handle < 0 || file->Handle >= MAX_FILE_HANDLES) return false;
-      if (!fd->Opened) return false;
-   }
+   FAT_FileData *fd = FAT_GetData(file);
+   if (!fd) return false;
 
    // Determine where the parent directory starts
    bool parentIsRoot = fd->ParentIsRoot;
    uint32_t parentCluster = fd->ParentCluster;
 
+   // The cached copy of the entry and open handles on the parent are about
+   // to go stale
+   uint32_t parentKey = parentIsRoot ? 0 : parentCluster;
+   FAT_DentryInvalidate(parentKey, (const char *)fd->Public.Name);
+   FAT_Node *parentNode = FAT_NodeFind(parentKey);
+   if (parentNode) parentNode->Generation++;
+
    // Guard against bogus parent cluster values (e.g., EOF markers)
    uint32_t eofMarker = (g_FatType == 12)   ? 0xFF8
                         : (g_FatType == 16) ? 0xFFF8
                                             : 0x0FFFFFF8;
    if (parentCluster >= eofMarker)
    {
-      printf("FAT_UpdateEntry: invalid parent cluster %u\n", parentCluster);
+      TRACE_ERROR(FAT, "FAT_UpdateEntry: invalid parent cluster %u\n",
+                  parentCluster);
       return false;
    }
 
@@ -1347,9 +2524,9 @@ bool FAT_UpdateEntry(Partition *disk, FAT_File *file)
                   updated.FirstClusterHigh = (fd->FirstCluster >> 16) & 0xFFFF;
                   memcpy(sectorBuffer + i, &updated,
                          sizeof(FAT_DirectoryEntry));
-                  printf("FAT_UpdateEntry: updating entry, Size=%u, "
-                         "FirstCluster=0x%x at LBA=%u\n",
-                         updated.Size, fd->FirstCluster, lba);
+                  TRACE_DEBUG(FAT, "FAT_UpdateEntry: updating entry, Size=%u, "
+                              "FirstCluster=0x%x at LBA=%u\n",
+                              updated.Size, fd->FirstCluster, lba);
                   return Partition_WriteSectors(disk, lba, 1, sectorBuffer);
                }
             }
@@ -1359,13 +2536,13 @@ bool FAT_UpdateEntry(Partition *disk, FAT_File *file)
       }
    }
 
-   printf("FAT: UpdateEntry - file not found in parent directory\n");
+   TRACE_ERROR(FAT, "FAT: UpdateEntry - file not found in parent directory\n");
    return false;
 }
 
 FAT_File *FAT_Create(Partition *disk, const char *path)
 {
-   printf("FAT_Create: called with name='%s'\n", path);
+   TRACE_DEBUG(FAT, "FAT_Create: called with name='%s'\n", path);
 
    if (!path) return NULL;
 
@@ -1394,7 +2571,7 @@ FAT_File *FAT_Create(Partition *disk, const char *path)
 
    if (baseName[0] == '\0')
    {
-      printf("FAT_Create: empty basename\n");
+      TRACE_ERROR(FAT, "FAT_Create: empty basename\n");
       return NULL;
    }
 
@@ -1404,67 +2581,33 @@ FAT_File *FAT_Create(Partition *disk, const char *path)
                               : FAT_Open(disk, parentPath);
    if (!parentFile || !parentFile->IsDirectory)
    {
-      printf("FAT_Create: parent directory '%s' not found\n",
-             parentPath[0] ? parentPath : "/");
+      TRACE_ERROR(FAT, "FAT_Create: parent directory '%s' not found\n",
+                  parentPath[0] ? parentPath : "/");
       return NULL;
    }
 
    // Convert basename to FAT 8.3
-   const char *name = baseName;
    char fatName[12];
-   memset(fatName, ' ', sizeof(fatName));
-   fatName[11] = '\0';
-
-   const char *ext = strchr(name, '.');
-   if (ext == NULL)
-      ext = name + strlen(name); // Point to end of string if no extension
-
-   int nameLen = (ext - name > 8) ? 8 : (ext - name);
-   for (int i = 0; i < nameLen && name[i] && name[i] != '.'; i++)
-      fatName[i] = toupper(name[i]);
-
-   if (ext != name + strlen(name) && *ext == '.')
-   {
-      for (int i = 0; i < 3 && ext[i + 1]; i++)
-         fatName[i + 8] = toupper(ext[i + 1]);
-   }
+   FAT_ToFatName(baseName, fatName);
 
    // Check if file already exists in parent
    FAT_DirectoryEntry existingEntry;
-   printf("FAT_Create: checking if '%s' exists in '%s'\n", baseName,
-          parentPath[0] ? parentPath : "/");
+   TRACE_DEBUG(FAT, "FAT_Create: checking if '%s' exists in '%s'\n", baseName,
+               parentPath[0] ? parentPath : "/");
    if (FAT_FindFile(disk, parentFile, baseName, &existingEntry))
    {
-      printf("FAT_Create: file '%s' already exists\n", baseName);
+      TRACE_INFO(FAT, "FAT_Create: file '%s' already exists\n", baseName);
       return NULL;
    }
-   printf("FAT_Create: file does not exist, proceeding\n");
+   TRACE_DEBUG(FAT, "FAT_Create: file does not exist, proceeding\n");
 
    // Find first free cluster for the file
-   uint32_t firstFreeCluster = 0;
-   uint32_t maxClusters = (g_TotalSectors - g_DataSectionLba) /
-                          g_Data->BS.BootSector.SectorsPerCluster;
-   printf("FAT_Create: max clusters = %u\n", maxClusters);
-
-   // Search all clusters (was previously limited to 1000 and could miss free
-   // space on larger images)
-   uint32_t maxSearchClusters = maxClusters;
-
-   for (uint32_t testCluster = 2; testCluster < maxSearchClusters;
-        testCluster++)
-   {
-      uint32_t nextClusterVal = FAT_NextCluster(disk, testCluster);
-      if (nextClusterVal == 0)
-      {
-         firstFreeCluster = testCluster;
-         printf("FAT_Create: found free cluster %u\n", firstFreeCluster);
-         break;
-      }
-   }
+   uint32_t firstFreeCluster = FAT_FindFreeCluster(disk, g_Data->NextFree);
+   TRACE_DEBUG(FAT, "FAT_Create: found free cluster %u\n", firstFreeCluster);
 
    if (firstFreeCluster == 0)
    {
-      printf("FAT_Create: no free clusters available\n");
+      TRACE_ERROR(FAT, "FAT_Create: no free clusters available\n");
       return NULL;
    }
 
@@ -1472,9 +2615,10 @@ FAT_File *FAT_Create(Partition *disk, const char *path)
    uint32_t eofVal = (g_FatType == 12)   ? 0x0FFF
                      : (g_FatType == 16) ? 0xFFFF
                                          : 0x0FFFFFFF;
-   if (!FAT_WriteFatEntry(disk, firstFreeCluster, eofVal))
+   if (!FAT_WriteFatEntry(disk, firstFreeCluster, eofVal) ||
+       !FAT_FlushFat(disk))
    {
-      printf("FAT_Create: FAT write error\n");
+      TRACE_ERROR(FAT, "FAT_Create: FAT write error\n");
       return NULL;
    }
 
@@ -1517,28 +2661,30 @@ FAT_File *FAT_Create(Partition *disk, const char *path)
          // Write the new entry
          if (!FAT_WriteEntry(disk, parentFile, &newEntry))
          {
-            printf("FAT_Create: failed to write directory entry\n");
+            TRACE_ERROR(FAT, "FAT_Create: failed to write directory entry\n");
             return NULL;
          }
 
          // Open the file (with parent context)
-         FAT_FileData *parentData =
-             (parentFile->Handle == ROOT_DIRECTORY_HANDLE)
-                 ? &g_Data->RootDirectory
-                 : &g_Data->OpenedFiles[parentFile->Handle];
-         FAT_File *file = FAT_OpenEntry(disk, &newEntry, parentData);
-         printf("FAT_Create: created file '%s' at cluster %u, opened: %s\n",
-                baseName, firstFreeCluster, file ? "yes" : "no");
+         FAT_FileData *parentData = FAT_GetData(parentFile);
+         FAT_DentryInsert(FAT_DirectoryKey(parentData), fatName, &newEntry);
+         FAT_File *file =
+             FAT_OpenEntry(disk, &newEntry, parentData->FirstCluster,
+                           parentData == &g_Data->RootDirectory);
+         TRACE_INFO(FAT,
+                    "FAT_Create: created file '%s' at cluster %u, opened: %s\n",
+                    baseName, firstFreeCluster, file ? "yes" : "no");
          if (file != NULL)
          {
-            printf("FAT_Create: file handle = %d\n", file->Handle);
+            TRACE_DEBUG(FAT, "FAT_Create: file handle = %d\n", file->Handle);
          }
          return file;
       }
    }
 
-   printf("FAT_Create: no space in root directory (checked %u entries)\n",
-          entryCount);
+   TRACE_ERROR(FAT,
+               "FAT_Create: no space in root directory (checked %u entries)\n",
+               entryCount);
    return NULL;
 }
 
@@ -1570,7 +2716,7 @@ bool FAT_Delete(Partition *disk, const char *name)
 
    if (baseName[0] == '\0')
    {
-      printf("FAT_Delete: empty basename in path\n");
+      TRACE_ERROR(FAT, "FAT_Delete: empty basename in path\n");
       return false;
    }
 
@@ -1578,15 +2724,16 @@ bool FAT_Delete(Partition *disk, const char *name)
                                                  : FAT_Open(disk, parentPath);
    if (!parentDir || !parentDir->IsDirectory)
    {
-      printf("FAT_Delete: parent directory '%s' not found\n", parentPath);
+      TRACE_ERROR(FAT, "FAT_Delete: parent directory '%s' not found\n",
+                  parentPath);
       return false;
    }
 
    FAT_DirectoryEntry entry;
    if (!FAT_FindFile(disk, parentDir, baseName, &entry))
    {
-      printf("FAT_Delete: file '%s' not found in '%s'\n", baseName,
-             parentPath[0] ? parentPath : "/");
+      TRACE_INFO(FAT, "FAT_Delete: file '%s' not found in '%s'\n", baseName,
+                 parentPath[0] ? parentPath : "/");
       return false;
    }
 
@@ -1596,11 +2743,11 @@ bool FAT_Delete(Partition *disk, const char *name)
    // If it's a directory, delete its contents best-effort
    if (entry.Attributes & FAT_ATTRIBUTE_DIRECTORY)
    {
-      FAT_FileData *parentData = (parentDir->Handle == ROOT_DIRECTORY_HANDLE)
-                                     ? &g_Data->RootDirectory
-                                     : &g_Data->OpenedFiles[parentDir->Handle];
+      FAT_FileData *parentData = FAT_GetData(parentDir);
 
-      FAT_File *dir = FAT_OpenEntry(disk, &entry, parentData);
+      FAT_File *dir =
+          FAT_OpenEntry(disk, &entry, parentData->FirstCluster,
+                        parentData == &g_Data->RootDirectory);
       if (dir)
       {
          FAT_DirectoryEntry subEntry;
@@ -1634,7 +2781,8 @@ bool FAT_Delete(Partition *disk, const char *name)
    if (g_Data->BS.BootSector.SectorsPerCluster == 0 ||
        g_Data->BS.BootSector.BytesPerSector == 0)
    {
-      printf("FAT_Delete: invalid FAT parameters, skipping cluster free\n");
+      TRACE_ERROR(FAT, "FAT_Delete: invalid FAT parameters, skipping cluster "
+                  "free\n");
       currentCluster = 0;
    }
 
@@ -1661,8 +2809,8 @@ bool FAT_Delete(Partition *disk, const char *name)
          uint32_t nextCluster = FAT_NextCluster(disk, currentCluster);
          if (!FAT_WriteFatEntry(disk, currentCluster, 0))
          {
-            printf("FAT_Delete: FAT write error freeing cluster %u\n",
-                   currentCluster);
+            TRACE_ERROR(FAT, "FAT_Delete: FAT write error freeing cluster %u\n",
+                        currentCluster);
             break;
          }
 
@@ -1671,9 +2819,17 @@ bool FAT_Delete(Partition *disk, const char *name)
    }
 
    // Mark directory entry as deleted within the parent directory
-   FAT_FileData *parentData = (parentDir->Handle == ROOT_DIRECTORY_HANDLE)
-                                  ? &g_Data->RootDirectory
-                                  : &g_Data->OpenedFiles[parentDir->Handle];
+   FAT_FileData *parentData = FAT_GetData(parentDir);
+
+   FAT_DentryInvalidate(FAT_DirectoryKey(parentData), (const char *)entry.Name);
+   if (entry.Attributes & FAT_ATTRIBUTE_DIRECTORY)
+      FAT_DentryInvalidateDirectory(firstCluster);
+
+   // Handles still open on the file keep their node, but its clusters may be
+   // reused by a new file from now on
+   FAT_Node *node = firstCluster ? FAT_NodeFind(firstCluster) : NULL;
+   if (node) FAT_NodeUnhash(node);
+   parentData->Node->Generation++;
 
    uint32_t sectorsPerCluster = g_Data->BS.BootSector.SectorsPerCluster;
    if (parentData == &g_Data->RootDirectory && g_FatType != 32)
@@ -1693,8 +2849,8 @@ bool FAT_Delete(Partition *disk, const char *name)
             {
                sectorBuffer[off] = 0xE5;
                Partition_WriteSectors(disk, lba, 1, sectorBuffer);
-               printf("FAT_Delete: deleted '%s'\n", name);
-               return true;
+               TRACE_INFO(FAT, "FAT_Delete: deleted '%s'\n", name);
+               return FAT_Sync(disk);
             }
          }
       }
@@ -1724,8 +2880,8 @@ bool FAT_Delete(Partition *disk, const char *name)
                {
                   sectorBuffer[off] = 0xE5;
                   Partition_WriteSectors(disk, lba, 1, sectorBuffer);
-                  printf("FAT_Delete: deleted '%s'\n", name);
-                  return true;
+                  TRACE_INFO(FAT, "FAT_Delete: deleted '%s'\n", name);
+                  return FAT_Sync(disk);
                }
             }
          }
@@ -1734,30 +2890,32 @@ bool FAT_Delete(Partition *disk, const char *name)
       }
    }
 
-   printf("FAT_Delete: entry not found during mark phase for '%s'\n", name);
+   TRACE_ERROR(FAT, "FAT_Delete: entry not found during mark phase for '%s'\n",
+               name);
    return false;
 }
 
 bool FAT_Truncate(Partition *disk, FAT_File *file)
 {
-   printf("FAT_Truncate: called, file=%p, Handle=%d\n", file,
-          file ? file->Handle : -999);
+   TRACE_DEBUG(FAT, "FAT_Truncate: called, file=%p, Handle=%d\n", file,
+               file ? file->Handle : -999);
    if (!file || file->Handle == ROOT_DIRECTORY_HANDLE) return false;
 
-   if (file->Handle < 0 || file->Handle >= MAX_FILE_HANDLES) return false;
+   FAT_FileData *fd = FAT_GetData(file);
+   TRACE_DEBUG(FAT, "FAT_Truncate: fd=%p\n", fd);
+   if (!fd) return false;
 
-   FAT_FileData *fd = &g_Data->OpenedFiles[file->Handle];
-   printf("FAT_Truncate: fd=%p, Opened=%d\n", fd, fd->Opened);
-   if (!fd->Opened) return false;
+   // The chain is about to change; forget its extents
+   fd->Node->ExtentCount = 0;
 
    // Validate FAT parameters to avoid divide-by-zero
    if (g_Data->BS.BootSector.SectorsPerCluster == 0 ||
        g_Data->BS.BootSector.BytesPerSector == 0)
    {
-      printf("FAT_Truncate: invalid FAT parameters (SectorsPerCluster=%u, "
-             "BytesPerSector=%u)\n",
-             g_Data->BS.BootSector.SectorsPerCluster,
-             g_Data->BS.BootSector.BytesPerSector);
+      TRACE_ERROR(FAT, "FAT_Truncate: invalid FAT parameters "
+                  "(SectorsPerCluster=%u, BytesPerSector=%u)\n",
+                  g_Data->BS.BootSector.SectorsPerCluster,
+                  g_Data->BS.BootSector.BytesPerSector);
       fd->FirstCluster = 0;
       fd->CurrentCluster = 0;
       fd->CurrentSectorInCluster = 0;
@@ -1778,21 +2936,23 @@ bool FAT_Truncate(Partition *disk, FAT_File *file)
       fd->CurrentSectorInCluster = 0;
       fd->Public.Position = 0;
       fd->Public.Size = 0;
+      FAT_Touch(fd);
       return true;
    }
 
    uint8_t fatBuffer[SECTOR_SIZE];
    int clusterCount = 0;
 
-   printf("FAT_Truncate: starting cluster chain cleanup, FirstCluster=%u, "
-          "g_FatType=%u\n",
-          fd->FirstCluster, g_FatType);
-   printf("FAT_Truncate: eofMarker=%u (0x%x)\n", eofMarker, eofMarker);
+   TRACE_DEBUG(FAT, "FAT_Truncate: starting cluster chain cleanup, "
+               "FirstCluster=%u, g_FatType=%u\n",
+               fd->FirstCluster, g_FatType);
+   TRACE_DEBUG(FAT, "FAT_Truncate: eofMarker=%u (0x%x)\n", eofMarker,
+               eofMarker);
 
    // Get the next cluster BEFORE freeing anything
    uint32_t nextCluster = FAT_NextCluster(disk, currentCluster);
-   printf("FAT_Truncate: FirstCluster nextCluster=%u, eofMarker=%u\n",
-          nextCluster, eofMarker);
+   TRACE_DEBUG(FAT, "FAT_Truncate: FirstCluster nextCluster=%u, eofMarker=%u\n",
+               nextCluster, eofMarker);
 
    // Free all clusters EXCEPT the first one (we want to keep that for potential
    // writes)
@@ -1802,14 +2962,15 @@ bool FAT_Truncate(Partition *disk, FAT_File *file)
       while (currentCluster >= 2 && currentCluster < eofMarker &&
              clusterCount < 5000)
       {
-         printf("FAT_Truncate: freeing cluster %u\n", currentCluster);
+         TRACE_DEBUG(FAT, "FAT_Truncate: freeing cluster %u\n", currentCluster);
          clusterCount++;
 
          uint32_t tempNextCluster = FAT_NextCluster(disk, currentCluster);
          if (!FAT_WriteFatEntry(disk, currentCluster, 0))
          {
-            printf("FAT_Truncate: FAT write error freeing cluster %u\n",
-                   currentCluster);
+            TRACE_ERROR(FAT,
+                        "FAT_Truncate: FAT write error freeing cluster %u\n",
+                        currentCluster);
             return false;
          }
 
@@ -1818,13 +2979,15 @@ bool FAT_Truncate(Partition *disk, FAT_File *file)
    }
 
    // Now mark the first cluster as EOF (end of chain)
-   printf("FAT_Truncate: marking first cluster %u as EOF\n", fd->FirstCluster);
+   TRACE_DEBUG(FAT, "FAT_Truncate: marking first cluster %u as EOF\n",
+               fd->FirstCluster);
    uint32_t eofVal = (g_FatType == 12)   ? 0x0FFF
                      : (g_FatType == 16) ? 0xFFFF
                                          : 0x0FFFFFFF;
    if (!FAT_WriteFatEntry(disk, fd->FirstCluster, eofVal))
    {
-      printf("FAT_Truncate: FAT write error marking first cluster as EOF\n");
+      TRACE_ERROR(FAT, "FAT_Truncate: FAT write error marking first cluster as "
+                  "EOF\n");
       return false;
    }
 
@@ -1840,11 +3003,58 @@ bool FAT_Truncate(Partition *disk, FAT_File *file)
    if (!Partition_ReadSectors(disk, FAT_ClusterToLba(fd->FirstCluster), 1,
                               fd->Buffer))
    {
-      printf("FAT_Truncate: failed to read first cluster into buffer\n");
+      TRACE_ERROR(FAT,
+                  "FAT_Truncate: failed to read first cluster into buffer\n");
       return false;
    }
 
-   g_Data->FatCachePos = 0xFFFFFFFF;
-   printf("FAT_Truncate: truncate complete, file ready for writes\n");
+   if (!FAT_FlushFat(disk))
+   {
+      TRACE_ERROR(FAT, "FAT_Truncate: FAT write back failed\n");
+      return false;
+   }
+
+   FAT_Touch(fd);
+   TRACE_DEBUG(FAT, "FAT_Truncate: truncate complete, file ready for writes\n");
    return true;
 }
+
+bool FAT_Allocate(Partition *disk, FAT_File *file, uint32_t byteCount)
+{
+   FAT_FileData *fd = FAT_GetData(file);
+   if (!fd || fd->Public.IsDirectory) return false;
+   if (!FAT_IsDataCluster(fd->FirstCluster))
+   {
+      TRACE_ERROR(FAT, "[FAT] allocate: file has no cluster chain\n");
+      return false;
+   }
+
+   uint32_t clusterBytes =
+       g_Data->BS.BootSector.SectorsPerCluster * SECTOR_SIZE;
+   uint32_t needed = byteCount / clusterBytes + (byteCount % clusterBytes != 0);
+
+   // Find the end of the chain
+   uint32_t last = fd->FirstCluster;
+   uint32_t have = 1;
+   while (have < needed)
+   {
+      uint32_t next = FAT_NextCluster(disk, last);
+      if (!FAT_IsDataCluster(next)) break;
+      last = next;
+      have++;
+   }
+   if (have >= needed) return true;
+
+   uint32_t first;
+   uint32_t added = FAT_ExtendChain(disk, last, needed - have, &first);
+   if (added > 0) fd->Node->Preallocated = true;
+
+   bool ok = FAT_FlushFat(disk);
+   if (added < needed - have)
+   {
+      TRACE_ERROR(FAT, "[FAT] allocate: reserved %u of %u clusters\n", added,
+                  needed - have);
+      ok = false;
+   }
+   return ok;
+}
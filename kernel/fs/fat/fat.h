@@ -43,7 +43,14 @@ enum FAT_Attributes
                        FAT_ATTRIBUTE_SYSTEM | FAT_ATTRIBUTE_VOLUME_ID
 };
 
-bool FAT_Initialize(Partition *disk);
+// Mount options for FAT_Initialize
+#define FAT_MOUNT_DEFAULT 0x00
+// Keep the whole FAT in memory along with a free-cluster bitmap. FAT updates
+// are written back on FAT_Sync. Falls back to the default sector window if
+// the FAT is too large or memory is short.
+#define FAT_MOUNT_TABLE 0x01
+
+bool FAT_Initialize(Partition *disk, uint32_t flags);
 FAT_File *FAT_Open(Partition *disk, const char *path);
 uint32_t FAT_Read(Partition *disk, FAT_File *file, uint32_t byteCount,
                   void *dataOut);
@@ -51,6 +58,17 @@ bool FAT_ReadEntry(Partition *disk, FAT_File *file,
                    FAT_DirectoryEntry *dirEntry);
 void FAT_Close(FAT_File *file);
 
+// Write all cached filesystem data (FAT, FSInfo, block cache) back to disk.
+// FAT_Close and FAT_Delete sync the mounted volume implicitly. Returns false
+// if a write failed.
+bool FAT_Sync(Partition *disk);
+
+// Size of the data area and how much of it is free, in sectors. The free
+// count is kept in memory (seeded from FSInfo on FAT32); only volumes without
+// one are scanned, on the first call.
+void FAT_GetUsage(Partition *disk, uint32_t *totalSectors,
+                  uint32_t *freeSectors);
+
 // Seek to a specific byte position in an opened FAT file. Returns true on
 // success. After seeking, the internal sector buffer will contain the sector
 // covering the requested position so subsequent FAT_Read calls read from the
@@ -67,6 +85,12 @@ bool FAT_WriteEntry(Partition *disk, FAT_File *file,
 uint32_t FAT_Write(Partition *disk, FAT_File *file, uint32_t byteCount,
                    const void *dataIn);
 
+// Reserve clusters so that the file's chain covers at least byteCount bytes,
+// as contiguous as free space allows. The file size does not change; clusters
+// past the end are given back when the last handle on the file is closed.
+// Returns false if not all of them could be reserved.
+bool FAT_Allocate(Partition *disk, FAT_File *file, uint32_t byteCount);
+
 // Truncate (shrink to 0 bytes) an opened file and free all its clusters.
 // File position and size are reset to 0. Returns true on success.
 bool FAT_Truncate(Partition *disk, FAT_File *file);
@@ -5,8 +5,10 @@
 #include <fs/disk/partition.h>
 #include <fs/fat/fat.h>
 #include <mem/heap.h>
+#include <mem/memory.h>
 #include <std/stdio.h>
 #include <std/string.h>
+#include <std/trace.h>
 
 /* Partition declared in main.c */
 extern Partition partition;
@@ -16,12 +18,12 @@ FileDescriptor *FD_Get(void *proc_ptr, int fd)
 {
    Process *proc = (Process *)proc_ptr;
 
-   if (!proc || fd < 0 || fd >= FD_TABLE_SIZE) return NULL;
+   if (!proc || fd < 0 || (uint32_t)fd >= proc->fd_capacity) return NULL;
 
    return proc->fd_table[fd];
 }
 
-// Helper: Find first free file descriptor
+// Helper: Find first free file descriptor, growing the table if it is full
 int FD_FindFree(void *proc_ptr)
 {
    Process *proc = (Process *)proc_ptr;
@@ -29,12 +31,24 @@ int FD_FindFree(void *proc_ptr)
    if (!proc) return -1;
 
    // Reserve 0, 1, 2 for stdin, stdout, stderr
-   for (int i = 3; i < FD_TABLE_SIZE; i++)
+   for (uint32_t i = 3; i < proc->fd_capacity; i++)
    {
       if (proc->fd_table[i] == NULL) return i;
    }
 
-   return -1; // EMFILE (too many open files)
+   if (proc->fd_capacity >= FD_MAX_SIZE) return -1; // EMFILE
+
+   uint32_t capacity =
+       proc->fd_capacity ? proc->fd_capacity * 2 : FD_INITIAL_SIZE;
+   void **table = realloc(proc->fd_table, capacity * sizeof(void *));
+   if (!table) return -1; // ENOMEM
+
+   memset(table + proc->fd_capacity, 0,
+          (capacity - proc->fd_capacity) * sizeof(void *));
+   int fd = proc->fd_capacity < 3 ? 3 : proc->fd_capacity;
+   proc->fd_table = table;
+   proc->fd_capacity = capacity;
+   return fd;
 }
 
 // Open a file and return file descriptor
@@ -48,7 +62,7 @@ int FD_Open(void *proc_ptr, const char *path, int flags)
    int fd = FD_FindFree(proc);
    if (fd == -1)
    {
-      printf("[fd] open: too many open files\n");
+      TRACE_ERROR(FD, "[fd] open: too many open files\n");
       return -1; // EMFILE
    }
 
@@ -56,7 +70,7 @@ int FD_Open(void *proc_ptr, const char *path, int flags)
    FileDescriptor *file = (FileDescriptor *)kmalloc(sizeof(FileDescriptor));
    if (!file)
    {
-      printf("[fd] open: kmalloc failed\n");
+      TRACE_ERROR(FD, "[fd] open: kmalloc failed\n");
       return -1; // ENOMEM
    }
 
@@ -77,14 +91,14 @@ int FD_Open(void *proc_ptr, const char *path, int flags)
    file->inode = FAT_Open(&partition, path);
    if (!file->inode)
    {
-      printf("[fd] open: file not found: %s\n", path);
+      TRACE_INFO(FD, "[fd] open: file not found: %s\n", path);
       free(file);
       return -1; // ENOENT
    }
 
    // Store in process FD table
    proc->fd_table[fd] = file;
-   printf("[fd] opened: fd=%d, path=%s\n", fd, path);
+   TRACE_DEBUG(FD, "[fd] opened: fd=%d, path=%s\n", fd, path);
 
    return fd;
 }
@@ -108,7 +122,7 @@ int FD_Close(void *proc_ptr, int fd)
    free(file);
    proc->fd_table[fd] = NULL;
 
-   printf("[fd] closed: fd=%d\n", fd);
+   TRACE_DEBUG(FD, "[fd] closed: fd=%d\n", fd);
    return 0;
 }
 
@@ -180,7 +194,7 @@ int FD_Lseek(void *proc_ptr, int fd, int32_t offset, int whence)
       break;
    case 2: // SEEK_END
       // Would need FAT_GetFileSize() to implement properly
-      printf("[fd] seek: SEEK_END not yet implemented\n");
+      TRACE_ERROR(FD, "[fd] seek: SEEK_END not yet implemented\n");
       return -1;
    default:
       return -1; // EINVAL
@@ -189,6 +203,33 @@ int FD_Lseek(void *proc_ptr, int fd, int32_t offset, int whence)
    return file->offset;
 }
 
+// Reserve contiguous space for [offset, offset + length) of a file
+int FD_Allocate(void *proc_ptr, int fd, int mode, uint32_t offset,
+                uint32_t length)
+{
+   Process *proc = (Process *)proc_ptr;
+
+   if (!proc) return -1;
+
+   FileDescriptor *file = FD_Get(proc, fd);
+   if (!file || fd < 3) return -1; // EBADF
+
+   if (!file->writable) return -1; // EBADF (not open for writing)
+
+   if (mode != FALLOC_FL_KEEP_SIZE)
+   {
+      TRACE_ERROR(FD, "[fd] fallocate: mode 0x%x not supported\n", mode);
+      return -1; // EOPNOTSUPP
+   }
+
+   if (length == 0 || offset + length < offset) return -1; // EINVAL / EFBIG
+
+   if (!FAT_Allocate(&partition, (FAT_File *)file->inode, offset + length))
+      return -1; // ENOSPC
+
+   return 0;
+}
+
 // Close all file descriptors for a process
 void FD_CloseAll(void *proc_ptr)
 {
@@ -196,8 +237,12 @@ void FD_CloseAll(void *proc_ptr)
 
    if (!proc) return;
 
-   for (int i = 3; i < FD_TABLE_SIZE; i++)
+   for (uint32_t i = 3; i < proc->fd_capacity; i++)
    {
       if (proc->fd_table[i] != NULL) FD_Close(proc, i);
    }
+
+   free(proc->fd_table);
+   proc->fd_table = NULL;
+   proc->fd_capacity = 0;
 }
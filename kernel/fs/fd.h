@@ -6,7 +6,10 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#define FD_TABLE_SIZE 16
+// A process's descriptor table starts at FD_INITIAL_SIZE slots and doubles
+// when full, up to FD_MAX_SIZE descriptors
+#define FD_INITIAL_SIZE 16
+#define FD_MAX_SIZE 1024
 #define O_RDONLY 0
 #define O_WRONLY 1
 #define O_RDWR 2
@@ -14,6 +17,10 @@
 #define O_CREAT 0x0040
 #define O_TRUNC 0x0200
 
+// FD_Allocate modes. Only reservations that keep the file size are
+// supported; clusters past the end are given back when the file is closed.
+#define FALLOC_FL_KEEP_SIZE 0x01
+
 typedef struct
 {
    char path[256];
@@ -30,6 +37,7 @@ int FD_Close(void *proc, int fd);
 int FD_Read(void *proc, int fd, void *buf, uint32_t count);
 int FD_Write(void *proc, int fd, const void *buf, uint32_t count);
 int FD_Lseek(void *proc, int fd, int32_t offset, int whence);
+int FD_Allocate(void *proc, int fd, int mode, uint32_t offset, uint32_t length);
 
 // Helper functions
 FileDescriptor *FD_Get(void *proc, int fd);
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
+#include <fs/disk/bcache.h>
 #include <fs/disk/disk.h>
 #include <fs/disk/partition.h>
 #include <fs/fat/fat.h>
@@ -30,6 +31,10 @@ bool FS_Initialize(DISK *disk, Partition *partition, uint8_t bootDrive)
 
    partition->disk = disk;
 
+   /* Partition I/O goes through the block cache; a failed allocation just
+    * leaves it disabled */
+   BCache_Initialize(BCACHE_DEFAULT_BLOCKS);
+
    /* For hard disks, read MBR and detect partition */
    if (disk->id >= 0x80) // Hard disk
    {
@@ -80,7 +85,7 @@ bool FS_Initialize(DISK *disk, Partition *partition, uint8_t bootDrive)
    }
 
    /* Initialize FAT filesystem on the detected partition */
-   if (!FAT_Initialize(partition))
+   if (!FAT_Initialize(partition, FAT_MOUNT_TABLE))
    {
       return false;
    }
@@ -89,6 +94,11 @@ bool FS_Initialize(DISK *disk, Partition *partition, uint8_t bootDrive)
    g_SysInfo->fs.mounted = 1;
    g_SysInfo->fs.read_only = 0;
    g_SysInfo->fs.block_size = 512;
+   uint32_t totalSectors, freeSectors;
+   FAT_GetUsage(partition, &totalSectors, &freeSectors);
+   g_SysInfo->fs.total_blocks = totalSectors;
+   g_SysInfo->fs.free_blocks = freeSectors;
+   g_SysInfo->fs.used_blocks = totalSectors - freeSectors;
    g_SysInfo->fs.type = FAT32; /* FAT */
    g_SysInfo->fs_count = 1;
 
@@ -8,6 +8,7 @@ void HAL_Initialize()
    i686_GDT_Initialize();
    i686_IDT_Initialize();
    i686_ISR_Initialize();
+   i686_ISR_RegisterHandler(14, i686_Paging_PageFaultIsr);
    i686_IRQ_Initialize();
    i686_PS2_Initialize();
 
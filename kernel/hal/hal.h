@@ -13,6 +13,7 @@
 #include <arch/i686/cpu/i8253.h>
 
 #include <arch/i686/drivers/ps2.h>
+#include <arch/i686/mem/paging.h>
 #include <arch/i686/syscall/syscall.h>
 #else
 #error "Unsupported architecture for HAL"
@@ -15,9 +15,14 @@
 #define HAL_ARCH_inb i686_inb
 #define HAL_ARCH_inw i686_inw
 #define HAL_ARCH_inl i686_inl
+#define HAL_ARCH_insw i686_insw
+#define HAL_ARCH_outsw i686_outsw
 #define HAL_ARCH_EnableInterrupts i686_EnableInterrupts
 #define HAL_ARCH_DisableInterrupts i686_DisableInterrupts
+#define HAL_ARCH_SaveInterrupts i686_SaveInterrupts
+#define HAL_ARCH_RestoreInterrupts i686_RestoreInterrupts
 #define HAL_ARCH_iowait i686_iowait
+#define HAL_ARCH_WaitForInterrupt i686_WaitForInterrupt
 #define HAL_ARCH_Halt i686_Halt
 #define HAL_ARCH_Panic i686_Panic
 #else
@@ -45,6 +50,16 @@ static inline uint16_t HAL_inw(uint16_t port) { return HAL_ARCH_inw(port); }
 
 static inline uint32_t HAL_inl(uint16_t port) { return HAL_ARCH_inl(port); }
 
+static inline void HAL_insw(uint16_t port, void *buffer, uint32_t count)
+{
+   HAL_ARCH_insw(port, buffer, count);
+}
+
+static inline void HAL_outsw(uint16_t port, const void *buffer, uint32_t count)
+{
+   HAL_ARCH_outsw(port, buffer, count);
+}
+
 static inline uint8_t HAL_EnableInterrupts()
 {
    return HAL_ARCH_EnableInterrupts();
@@ -55,8 +70,17 @@ static inline uint8_t HAL_DisableInterrupts()
    return HAL_ARCH_DisableInterrupts();
 }
 
+static inline uint32_t HAL_SaveInterrupts() { return HAL_ARCH_SaveInterrupts(); }
+
+static inline void HAL_RestoreInterrupts(uint32_t flags)
+{
+   HAL_ARCH_RestoreInterrupts(flags);
+}
+
 static inline void HAL_IOWait() { HAL_ARCH_iowait(); }
 
+static inline void HAL_WaitForInterrupt() { HAL_ARCH_WaitForInterrupt(); }
+
 static inline void HAL_Halt() { HAL_ARCH_Halt(); }
 
 static inline void HAL_Panic() { HAL_ARCH_Panic(); }
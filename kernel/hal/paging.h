@@ -14,9 +14,12 @@
 #define HAL_ARCH_Paging_Enable i686_Paging_Enable
 #define HAL_ARCH_Paging_CreatePageDirectory i686_Paging_CreatePageDirectory
 #define HAL_ARCH_Paging_DestroyPageDirectory i686_Paging_DestroyPageDirectory
+#define HAL_ARCH_Paging_CloneAddressSpace i686_Paging_CloneAddressSpace
+#define HAL_ARCH_Paging_HandleCowFault i686_Paging_HandleCowFault
 #define HAL_ARCH_Paging_MapPage i686_Paging_MapPage
 #define HAL_ARCH_Paging_UnmapPage i686_Paging_UnmapPage
 #define HAL_ARCH_Paging_GetPhysicalAddress i686_Paging_GetPhysicalAddress
+#define HAL_ARCH_Paging_ZeroPhysicalPage i686_Paging_ZeroPhysicalPage
 #define HAL_ARCH_Paging_IsPageMapped i686_Paging_IsPageMapped
 #define HAL_ARCH_Paging_PageFaultHandler i686_Paging_PageFaultHandler
 #define HAL_ARCH_Paging_InvalidateTlbEntry i686_Paging_InvalidateTlbEntry
@@ -46,6 +49,14 @@ static inline void HAL_Paging_DestroyPageDirectory(void *page_dir){
     HAL_ARCH_Paging_DestroyPageDirectory(page_dir);
 }
 
+static inline void *HAL_Paging_CloneAddressSpace(void *page_dir){
+    return HAL_ARCH_Paging_CloneAddressSpace(page_dir);
+}
+
+static inline bool HAL_Paging_HandleCowFault(void *page_dir, uint32_t vaddr){
+    return HAL_ARCH_Paging_HandleCowFault(page_dir, vaddr);
+}
+
 static inline bool HAL_Paging_MapPage(void *page_dir, uint32_t vaddr, uint32_t paddr, uint32_t flags){
     return HAL_ARCH_Paging_MapPage(page_dir, vaddr, paddr, flags);
 }
@@ -58,6 +69,10 @@ static inline uint32_t HAL_Paging_GetPhysicalAddress(void *page_dir, uint32_t va
     return HAL_ARCH_Paging_GetPhysicalAddress(page_dir, vaddr);
 }
 
+static inline void HAL_Paging_ZeroPhysicalPage(uint32_t phys){
+    HAL_ARCH_Paging_ZeroPhysicalPage(phys);
+}
+
 static inline bool HAL_Paging_IsPageMapped(void *page_dir, uint32_t vaddr){
     return HAL_ARCH_Paging_IsPageMapped(page_dir, vaddr);
 }
@@ -11,6 +11,7 @@
 #include <hal/irq.h>
 #include <mem/heap.h>
 #include <mem/memory.h>
+#include <mem/pmm.h>
 #include <std/stdio.h>
 #include <std/string.h>
 #include <stdint.h>
@@ -38,8 +39,8 @@ void __attribute__((section(".entry"))) start(uint16_t bootDrive,
 
    MEM_Initialize(multiboot_info_ptr);
    SYS_Initialize();
-   CPU_Initialize();
    HAL_Initialize();
+   CPU_Initialize(); // process self-test relies on the page fault handler
 
    DISK disk;
    Partition partition;
@@ -71,6 +72,9 @@ void __attribute__((section(".entry"))) start(uint16_t bootDrive,
          last_uptime = g_SysInfo->uptime_seconds;
       }
 
+      /* Use idle time to keep the pre-zeroed page pool topped up */
+      PMM_RefillZeroPool(PMM_ZERO_POOL_BATCH);
+
       /* Idle efficiently until next interrupt: enable interrupts, HLT,
          then disable again. Matches i686 PS/2 idle usage. */
       __asm__ volatile("sti; hlt; cli");
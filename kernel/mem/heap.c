@@ -5,40 +5,100 @@
 #include "pmm.h"
 #include <cpu/process.h>
 #include <std/stdio.h>
+#include <std/string.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <hal/paging.h>
 
 extern uint8_t __end; /* linker-provided end of kernel image */
 
-/* Simple bump allocator state */
+/* Kernel heap
+ *
+ * The arena [heap_start, heap_end) is handed out in whole pages. Pages below
+ * the break (heap_ptr) are either owned by an allocation or sit on a sorted,
+ * coalescing free-run list; everything above the break is untouched
+ * wilderness. Small requests are served from per-size-class slabs (one page
+ * each, header at the page base); anything larger gets a page run with a
+ * small header, so free() finds the owner by rounding the pointer down.
+ */
+#define HEAP_SLAB_MAGIC 0x534C4142u  /* 'SLAB' */
+#define HEAP_LARGE_MAGIC 0x4C524745u /* 'LRGE' */
+#define HEAP_SLAB_HEADER 32u
+#define HEAP_LARGE_HEADER 16u
+#define HEAP_ALIGN 16u
+#define HEAP_MAX_SMALL 2032u
+
+typedef struct HeapSlab
+{
+   uint32_t magic;
+   uint16_t class_idx;
+   uint16_t in_use;
+   uint16_t capacity;
+   uint16_t _reserved;
+   void *free_list;
+   struct HeapSlab *next;
+   struct HeapSlab *prev;
+   uint32_t _pad[2];
+} HeapSlab;
+
+typedef struct
+{
+   uint32_t magic;
+   uint32_t pages;
+   uint32_t size;
+   uint32_t _reserved;
+} HeapLarge;
+
+typedef struct HeapRun
+{
+   uint32_t pages;
+   struct HeapRun *next;
+} HeapRun;
+
+typedef struct
+{
+   uint32_t size;
+   uint32_t slabs;
+   uint32_t in_use;
+   HeapSlab *partial; /* slabs with at least one free slot */
+   HeapSlab *empty;   /* one fully free slab kept to absorb churn */
+} HeapClass;
+
+/* Slot sizes are multiples of HEAP_ALIGN chosen so each slab page packs
+ * with little tail waste. */
+static HeapClass heap_classes[HEAP_SIZE_CLASSES] = {
+    {.size = 16},  {.size = 32},  {.size = 48},   {.size = 64},
+    {.size = 96},  {.size = 128}, {.size = 192},  {.size = 256},
+    {.size = 384}, {.size = 512}, {.size = 672},  {.size = 800},
+    {.size = 1008}, {.size = 1344}, {.size = 2032}};
+static uint8_t heap_class_lookup[HEAP_MAX_SMALL / HEAP_ALIGN + 1];
+
 static uintptr_t heap_start = 0;
 static uintptr_t heap_end = 0;
-static uintptr_t heap_ptr = 0;
+static uintptr_t heap_ptr = 0; /* break: top of pages carved from the arena */
+static HeapRun *heap_free_runs = NULL;
+static uint32_t heap_free_run_pages = 0;
+static uint32_t heap_live_bytes = 0;
+static uint32_t heap_large_pages = 0;
+static uint32_t heap_large_count = 0;
+
+/* Process heaps are demand paged: brk only moves the break, and pages in
+ * [heap_start, heap_end) are allocated zeroed by Heap_ProcessHandleFault()
+ * the first time they are touched.
+ */
+#define PROCESS_HEAP_FLAGS (HAL_PAGE_PRESENT | HAL_PAGE_RW | HAL_PAGE_USER)
+
+static inline uint32_t page_round_up(uint32_t v)
+{
+   return (v + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
 
 int Heap_ProcessInitialize(Process *proc, uint32_t heap_start_va)
 {
    if (!proc) return -1;
 
+   // Reserve the initial heap page; it is populated on first access
    proc->heap_start = heap_start_va;
-   proc->heap_end = heap_start_va;
-
-   // Allocate initial heap page
-   uint32_t phys = PMM_AllocatePhysicalPage();
-   if (phys == 0)
-   {
-      printf("[process] Heap_Initialize: PMM_AllocatePhysicalPage failed\n");
-      return -1;
-   }
-
-   // Map to process page directory
-   if (!HAL_Paging_MapPage(proc->page_directory, heap_start_va, phys, 0x007))
-   { // RW, Present
-      printf("[process] Heap_Initialize: map_page failed\n");
-      PMM_FreePhysicalPage(phys);
-      return -1;
-   }
-
    proc->heap_end = heap_start_va + PAGE_SIZE;
    printf("[process] Heap_Initialize: pid=%u heap at 0x%08x-0x%08x\n",
           proc->pid, proc->heap_start, proc->heap_end);
@@ -52,28 +112,18 @@ int Heap_ProcessBrk(Process *proc, void *addr)
    uintptr_t target = (uintptr_t)addr;
    if (target < proc->heap_start || target > HEAP_MAX) return -1;
 
-   // If extending heap, allocate pages
-   if (target > proc->heap_end)
+   // Shrinking hands back every populated page above the new break
+   if (target < proc->heap_end)
    {
-      uint32_t pages_needed =
-          (target - proc->heap_end + PAGE_SIZE - 1) / PAGE_SIZE;
-      for (uint32_t i = 0; i < pages_needed; ++i)
+      uint32_t first = page_round_up(target);
+      uint32_t last = page_round_up(proc->heap_end);
+      for (uint32_t va = first; va < last; va += PAGE_SIZE)
       {
-         uint32_t va = proc->heap_end + (i * PAGE_SIZE);
-         uint32_t phys = PMM_AllocatePhysicalPage();
-         if (phys == 0)
-         {
-            printf("[process] brk: PMM_AllocatePhysicalPage failed at page "
-                   "%u/%u\n",
-                   i, pages_needed);
-            return -1;
-         }
-         if (!HAL_Paging_MapPage(proc->page_directory, va, phys, 0x007))
-         { // RW, Present
-            printf("[process] brk: map_page failed at 0x%08x\n", va);
-            PMM_FreePhysicalPage(phys);
-            return -1;
-         }
+         uint32_t phys =
+             HAL_Paging_GetPhysicalAddress(proc->page_directory, va);
+         if (!phys) continue;
+         HAL_Paging_UnmapPage(proc->page_directory, va);
+         PMM_FreePhysicalPage(phys & ~(PAGE_SIZE - 1));
       }
    }
 
@@ -81,6 +131,30 @@ int Heap_ProcessBrk(Process *proc, void *addr)
    return 0;
 }
 
+bool Heap_ProcessHandleFault(Process *proc, uint32_t fault_addr)
+{
+   if (!proc || proc->kernel_mode) return false;
+   if (fault_addr < proc->heap_start ||
+       fault_addr >= page_round_up(proc->heap_end))
+      return false;
+
+   uint32_t va = fault_addr & ~(PAGE_SIZE - 1);
+   uint32_t phys = PMM_AllocateZeroedPage();
+   if (phys == 0)
+   {
+      printf("[process] heap fault: out of memory at 0x%08x\n", fault_addr);
+      return false;
+   }
+
+   if (!HAL_Paging_MapPage(proc->page_directory, va, phys, PROCESS_HEAP_FLAGS))
+   {
+      printf("[process] heap fault: map_page failed at 0x%08x\n", va);
+      PMM_FreePhysicalPage(phys);
+      return false;
+   }
+   return true;
+}
+
 void *Heap_ProcessSbrk(Process *proc, intptr_t inc)
 {
    if (!proc) return (void *)-1;
@@ -106,34 +180,312 @@ static uintptr_t align_up(uintptr_t v, size_t align)
 
 void Heap_Initialize(void)
 {
-   /* place heap just after the kernel image end symbol */
-   heap_start = align_up((uintptr_t)&__end, 8);
+   /* kmalloc may run before MEM_Initialize; keep the first setup */
+   if (heap_start) return;
 
-   /* cap heap to 2 GiB from heap_start (but do not exceed 32-bit max) */
-   const uintptr_t two_gib = (uintptr_t)2 * 1024 * 1024 * 1024u;
-   uintptr_t desired_end = heap_start + (two_gib - 1);
-   if (desired_end < heap_start || desired_end > (uintptr_t)0xFFFFFFFFu)
-      heap_end = (uintptr_t)0xFFFFFFFFu;
-   else
-      heap_end = desired_end;
+   /* place heap on the first page after the kernel image end symbol */
+   heap_start = align_up((uintptr_t)&__end, PAGE_SIZE);
+   heap_end = KERNEL_HEAP_LIMIT;
+   if (heap_start >= heap_end)
+   {
+      printf("[heap] ERROR: kernel image overlaps heap limit 0x%08x\n",
+             (uint32_t)heap_end);
+      heap_end = heap_start;
+   }
 
    heap_ptr = heap_start;
+   heap_free_runs = NULL;
+   heap_free_run_pages = 0;
+
+   uint32_t cls = 0;
+   for (uint32_t i = 0; i < sizeof(heap_class_lookup); ++i)
+   {
+      while (heap_classes[cls].size < i * HEAP_ALIGN) cls++;
+      heap_class_lookup[i] = (uint8_t)cls;
+   }
+}
+
+/* Page runs --------------------------------------------------------------- */
+
+static void *heap_alloc_pages(uint32_t pages)
+{
+   /* first fit over the free runs, splitting from the front */
+   HeapRun **link = &heap_free_runs;
+   while (*link)
+   {
+      HeapRun *run = *link;
+      if (run->pages >= pages)
+      {
+         if (run->pages == pages)
+            *link = run->next;
+         else
+         {
+            HeapRun *rest = (HeapRun *)((uintptr_t)run + pages * PAGE_SIZE);
+            rest->pages = run->pages - pages;
+            rest->next = run->next;
+            *link = rest;
+         }
+         heap_free_run_pages -= pages;
+         return run;
+      }
+      link = &run->next;
+   }
+
+   /* otherwise carve fresh pages from the wilderness */
+   if ((heap_end - heap_ptr) / PAGE_SIZE < pages) return NULL;
+   void *p = (void *)heap_ptr;
+   heap_ptr += pages * PAGE_SIZE;
+   return p;
+}
+
+static void heap_free_pages(void *addr, uint32_t pages)
+{
+   uintptr_t base = (uintptr_t)addr;
+   HeapRun *prev = NULL;
+   HeapRun *next = heap_free_runs;
+   while (next && (uintptr_t)next < base)
+   {
+      prev = next;
+      next = next->next;
+   }
+
+   HeapRun *run = (HeapRun *)base;
+   run->pages = pages;
+   run->next = next;
+   heap_free_run_pages += pages;
+
+   /* merge with the following run */
+   if (next && base + pages * PAGE_SIZE == (uintptr_t)next)
+   {
+      run->pages += next->pages;
+      run->next = next->next;
+   }
+
+   /* merge with the preceding run */
+   if (prev && (uintptr_t)prev + prev->pages * PAGE_SIZE == base)
+   {
+      prev->pages += run->pages;
+      prev->next = run->next;
+   }
+   else if (prev)
+      prev->next = run;
+   else
+      heap_free_runs = run;
+
+   /* a last run touching the break goes back to the wilderness */
+   HeapRun **last = &heap_free_runs;
+   while ((*last)->next) last = &(*last)->next;
+   if ((uintptr_t)*last + (*last)->pages * PAGE_SIZE == heap_ptr)
+   {
+      heap_ptr = (uintptr_t)*last;
+      heap_free_run_pages -= (*last)->pages;
+      *last = NULL;
+   }
+}
+
+/* Try to take `pages` pages starting exactly at `addr` (used by realloc to
+ * grow a large block in place). */
+static bool heap_claim_pages_at(uintptr_t addr, uint32_t pages)
+{
+   if (addr == heap_ptr)
+   {
+      if ((heap_end - heap_ptr) / PAGE_SIZE < pages) return false;
+      heap_ptr += pages * PAGE_SIZE;
+      return true;
+   }
+
+   HeapRun **link = &heap_free_runs;
+   while (*link && (uintptr_t)*link < addr) link = &(*link)->next;
+
+   HeapRun *run = *link;
+   if (!run || (uintptr_t)run != addr) return false;
+
+   uint32_t run_pages = run->pages;
+   HeapRun *after = run->next;
+   if (run_pages < pages)
+   {
+      /* the run may end at the break; top up from the wilderness */
+      uintptr_t run_end = addr + run_pages * PAGE_SIZE;
+      if (run_end != heap_ptr ||
+          (heap_end - heap_ptr) / PAGE_SIZE < pages - run_pages)
+         return false;
+      heap_ptr += (pages - run_pages) * PAGE_SIZE;
+      *link = after;
+      heap_free_run_pages -= run_pages;
+      return true;
+   }
+
+   if (run_pages == pages)
+      *link = after;
+   else
+   {
+      HeapRun *rest = (HeapRun *)(addr + pages * PAGE_SIZE);
+      rest->pages = run_pages - pages;
+      rest->next = after;
+      *link = rest;
+   }
+   heap_free_run_pages -= pages;
+   return true;
+}
+
+/* Slabs ------------------------------------------------------------------- */
+
+static HeapSlab *heap_slab_create(uint32_t class_idx)
+{
+   HeapSlab *slab = (HeapSlab *)heap_alloc_pages(1);
+   if (!slab) return NULL;
+
+   HeapClass *cls = &heap_classes[class_idx];
+   slab->magic = HEAP_SLAB_MAGIC;
+   slab->class_idx = (uint16_t)class_idx;
+   slab->in_use = 0;
+   slab->capacity = (uint16_t)((PAGE_SIZE - HEAP_SLAB_HEADER) / cls->size);
+   slab->next = slab->prev = NULL;
+
+   /* thread the free list through the slots in address order */
+   uint8_t *slot = (uint8_t *)slab + HEAP_SLAB_HEADER;
+   slab->free_list = slot;
+   for (uint16_t i = 0; i + 1 < slab->capacity; ++i)
+   {
+      *(void **)slot = slot + cls->size;
+      slot += cls->size;
+   }
+   *(void **)slot = NULL;
+
+   cls->slabs++;
+   return slab;
+}
+
+static void heap_slab_link(HeapClass *cls, HeapSlab *slab)
+{
+   slab->prev = NULL;
+   slab->next = cls->partial;
+   if (cls->partial) cls->partial->prev = slab;
+   cls->partial = slab;
+}
+
+static void heap_slab_unlink(HeapClass *cls, HeapSlab *slab)
+{
+   if (slab->prev)
+      slab->prev->next = slab->next;
+   else
+      cls->partial = slab->next;
+   if (slab->next) slab->next->prev = slab->prev;
+   slab->next = slab->prev = NULL;
+}
+
+static void *heap_slab_alloc(uint32_t class_idx)
+{
+   HeapClass *cls = &heap_classes[class_idx];
+   HeapSlab *slab = cls->partial;
+
+   if (!slab)
+   {
+      if (cls->empty)
+      {
+         slab = cls->empty;
+         cls->empty = NULL;
+      }
+      else
+      {
+         slab = heap_slab_create(class_idx);
+         if (!slab) return NULL;
+      }
+      heap_slab_link(cls, slab);
+   }
+
+   void *obj = slab->free_list;
+   slab->free_list = *(void **)obj;
+   slab->in_use++;
+   cls->in_use++;
+   heap_live_bytes += cls->size;
+
+   /* full slabs leave the partial list until something is freed */
+   if (!slab->free_list) heap_slab_unlink(cls, slab);
+   return obj;
+}
+
+static void heap_slab_free(HeapSlab *slab, void *ptr)
+{
+   HeapClass *cls = &heap_classes[slab->class_idx];
+   bool was_full = (slab->free_list == NULL);
+
+   *(void **)ptr = slab->free_list;
+   slab->free_list = ptr;
+   slab->in_use--;
+   cls->in_use--;
+   heap_live_bytes -= cls->size;
+
+   if (was_full) heap_slab_link(cls, slab);
+   if (slab->in_use != 0) return;
+
+   /* keep a single empty slab per class; return any extra to the arena */
+   heap_slab_unlink(cls, slab);
+   if (!cls->empty)
+   {
+      cls->empty = slab;
+      return;
+   }
+   slab->magic = 0;
+   cls->slabs--;
+   heap_free_pages(slab, 1);
+}
+
+/* Large blocks ------------------------------------------------------------ */
+
+static uint32_t heap_large_pages_for(size_t size)
+{
+   return (uint32_t)((size + HEAP_LARGE_HEADER + PAGE_SIZE - 1) / PAGE_SIZE);
+}
+
+static void *heap_large_alloc(size_t size)
+{
+   uint32_t pages = heap_large_pages_for(size);
+   HeapLarge *hdr = (HeapLarge *)heap_alloc_pages(pages);
+   if (!hdr) return NULL;
+
+   hdr->magic = HEAP_LARGE_MAGIC;
+   hdr->pages = pages;
+   hdr->size = (uint32_t)size;
+   heap_large_pages += pages;
+   heap_large_count++;
+   heap_live_bytes += (uint32_t)size;
+   return (uint8_t *)hdr + HEAP_LARGE_HEADER;
+}
+
+static void heap_large_free(HeapLarge *hdr)
+{
+   heap_large_pages -= hdr->pages;
+   heap_large_count--;
+   heap_live_bytes -= hdr->size;
+   hdr->magic = 0;
+   heap_free_pages(hdr, hdr->pages);
+}
+
+/* Resolve the page header owning ptr; NULL if it does not look like ours */
+static uint32_t *heap_owner(void *ptr)
+{
+   uintptr_t p = (uintptr_t)ptr;
+   if (p < heap_start || p >= heap_ptr) return NULL;
+
+   uint32_t *hdr = (uint32_t *)(p & ~(uintptr_t)(PAGE_SIZE - 1));
+   if (*hdr == HEAP_SLAB_MAGIC || *hdr == HEAP_LARGE_MAGIC) return hdr;
+   return NULL;
 }
 
+/* Core allocators --------------------------------------------------------- */
+
 void *kmalloc(size_t size)
 {
    if (size == 0) return NULL;
+   if (!heap_start) Heap_Initialize();
 
-   uintptr_t cur = align_up(heap_ptr, 8);
-   if (cur > heap_end) return NULL; /* heap already exhausted */
+   if (size <= HEAP_MAX_SMALL)
+      return heap_slab_alloc(heap_class_lookup[(size + HEAP_ALIGN - 1) /
+                                               HEAP_ALIGN]);
 
-   /* available bytes from cur to heap_end (inclusive) */
-   uintptr_t avail = (heap_end - cur) + 1;
-   if (size > avail) return NULL; /* not enough room */
-
-   uintptr_t next = cur + size;
-   heap_ptr = next;
-   return (void *)cur;
+   if (size > heap_end - heap_start) return NULL;
+   return heap_large_alloc(size);
 }
 
 void *kzalloc(size_t size)
@@ -152,12 +504,24 @@ void *malloc(size_t size) { return kmalloc(size); }
 
 void free(void *ptr)
 {
-   /* No-op: bump allocator does not reclaim memory. */
-   (void)ptr;
+   if (!ptr) return;
+
+   uint32_t *hdr = heap_owner(ptr);
+   if (!hdr)
+   {
+      printf("[heap] free: invalid pointer 0x%08x\n", (uint32_t)ptr);
+      return;
+   }
+
+   if (*hdr == HEAP_SLAB_MAGIC)
+      heap_slab_free((HeapSlab *)hdr, ptr);
+   else
+      heap_large_free((HeapLarge *)hdr);
 }
 
 void *calloc(size_t nmemb, size_t size)
 {
+   if (size && nmemb > (size_t)-1 / size) return NULL;
    size_t total = nmemb * size;
    return kzalloc(total);
 }
@@ -171,13 +535,63 @@ void *realloc(void *ptr, size_t size)
       return NULL;
    }
 
+   uint32_t *hdr = heap_owner(ptr);
+   if (!hdr)
+   {
+      printf("[heap] realloc: invalid pointer 0x%08x\n", (uint32_t)ptr);
+      return NULL;
+   }
+
+   size_t old_size;
+   if (*hdr == HEAP_SLAB_MAGIC)
+   {
+      /* anything that still fits the slot stays where it is */
+      old_size = heap_classes[((HeapSlab *)hdr)->class_idx].size;
+      if (size <= old_size) return ptr;
+   }
+   else
+   {
+      HeapLarge *large = (HeapLarge *)hdr;
+      if (size > heap_end - heap_start) return NULL;
+
+      uint32_t pages = heap_large_pages_for(size);
+      old_size = large->size;
+      if (pages <= large->pages)
+      {
+         /* shrink in place, handing surplus tail pages back */
+         if (pages < large->pages)
+         {
+            heap_free_pages((uint8_t *)large + pages * PAGE_SIZE,
+                            large->pages - pages);
+            heap_large_pages -= large->pages - pages;
+            large->pages = pages;
+         }
+         heap_live_bytes = heap_live_bytes - large->size + (uint32_t)size;
+         large->size = (uint32_t)size;
+         return ptr;
+      }
+      else if (heap_claim_pages_at((uintptr_t)large + large->pages * PAGE_SIZE,
+                                   pages - large->pages))
+      {
+         /* grew into the adjacent free run or the wilderness */
+         heap_large_pages += pages - large->pages;
+         heap_live_bytes = heap_live_bytes - large->size + (uint32_t)size;
+         large->pages = pages;
+         large->size = (uint32_t)size;
+         return ptr;
+      }
+   }
+
    void *n = kmalloc(size);
    if (!n) return NULL;
-   memcpy(n, ptr, size);
+   memcpy(n, ptr, old_size < size ? old_size : size);
+   free(ptr);
    return n;
 }
 
 /* brk/sbrk -------------------------------------------------------------- */
+/* Raw control of the arena break. Memory obtained this way is invisible to
+ * the allocator; callers must only hand back what they took. */
 int brk(void *addr)
 {
    uintptr_t target = (uintptr_t)addr;
@@ -199,6 +613,59 @@ void *sbrk(intptr_t inc)
    return (void *)old;
 }
 
+/* Statistics ------------------------------------------------------------ */
+void heap_stats(HeapStats *out)
+{
+   if (!out) return;
+   memset(out, 0, sizeof(*out));
+
+   uint32_t slab_pages = 0;
+   for (uint32_t i = 0; i < HEAP_SIZE_CLASSES; ++i)
+   {
+      HeapClass *cls = &heap_classes[i];
+      uint32_t per_slab = (PAGE_SIZE - HEAP_SLAB_HEADER) / cls->size;
+      out->classes[i].object_size = cls->size;
+      out->classes[i].slabs = cls->slabs;
+      out->classes[i].in_use = cls->in_use;
+      out->classes[i].free = cls->slabs * per_slab - cls->in_use;
+      slab_pages += cls->slabs;
+   }
+
+   uint32_t largest = (uint32_t)(heap_end - heap_ptr);
+   for (HeapRun *run = heap_free_runs; run; run = run->next)
+      if (run->pages * PAGE_SIZE > largest) largest = run->pages * PAGE_SIZE;
+
+   out->arena_bytes = (uint32_t)(heap_end - heap_start);
+   out->committed_bytes = (slab_pages + heap_large_pages) * PAGE_SIZE;
+   out->live_bytes = heap_live_bytes;
+   out->free_run_bytes = heap_free_run_pages * PAGE_SIZE;
+   out->largest_free_run = largest;
+   out->large_allocs = heap_large_count;
+   if (out->committed_bytes)
+      out->fragmentation =
+          (uint32_t)(((uint64_t)(out->committed_bytes - out->live_bytes) *
+                      100) /
+                     out->committed_bytes);
+}
+
+void heap_print_stats(void)
+{
+   HeapStats st;
+   heap_stats(&st);
+
+   printf("[heap] live=%u committed=%u frag=%u%% free-runs=%u largest=%u "
+          "large=%u\n",
+          st.live_bytes, st.committed_bytes, st.fragmentation,
+          st.free_run_bytes, st.largest_free_run, st.large_allocs);
+   for (uint32_t i = 0; i < HEAP_SIZE_CLASSES; ++i)
+   {
+      if (!st.classes[i].slabs) continue;
+      printf("[heap]   %4u B: slabs=%u used=%u free=%u\n",
+             st.classes[i].object_size, st.classes[i].slabs,
+             st.classes[i].in_use, st.classes[i].free);
+   }
+}
+
 /* Self-test ------------------------------------------------------------- */
 void heap_self_test(void)
 {
@@ -231,12 +698,38 @@ void heap_self_test(void)
          zeroed = 0;
          break;
       }
+   free(z);
+   free(q);
+
+   /* churn: mixed sizes allocated and released must leave usage flat */
+   HeapStats before, after;
+   heap_stats(&before);
+   void *blocks[48];
+   for (int round = 0; round < 4; ++round)
+   {
+      for (int i = 0; i < 48; ++i)
+         blocks[i] = kmalloc((size_t)(16 + (i * 37 + round * 101) % 6000));
+      for (int i = 0; i < 48; i += 2) free(blocks[i]);
+      for (int i = 1; i < 48; i += 2) free(blocks[i]);
+   }
+   heap_stats(&after);
+   int churn_ok = (after.live_bytes == before.live_bytes &&
+                   after.large_allocs == before.large_allocs);
+
+   /* a large block shrinks and grows back over its own tail in place */
+   uint8_t *big = (uint8_t *)kmalloc(6 * PAGE_SIZE);
+   uint8_t *shrunk = big ? (uint8_t *)realloc(big, 2 * PAGE_SIZE) : NULL;
+   uint8_t *grown = shrunk ? (uint8_t *)realloc(shrunk, 6 * PAGE_SIZE) : NULL;
+   int inplace_ok = (big && shrunk == big && grown == big);
+   free(grown ? grown : (shrunk ? shrunk : big));
 
    void *brk0 = sbrk(0);
    void *brk1 = sbrk(4096);
    int brk_ok = (brk1 != (void *)-1);
    brk(brk0);
 
-   printf("[heap] test kmalloc/realloc copy=%s, calloc zero=%s, sbrk=%s\n",
-          ok ? "OK" : "FAIL", zeroed ? "OK" : "FAIL", brk_ok ? "OK" : "FAIL");
+   printf("[heap] test kmalloc/realloc copy=%s, calloc zero=%s, sbrk=%s, "
+          "churn=%s, in-place=%s\n",
+          ok ? "OK" : "FAIL", zeroed ? "OK" : "FAIL", brk_ok ? "OK" : "FAIL",
+          churn_ok ? "OK" : "FAIL", inplace_ok ? "OK" : "FAIL");
 }
@@ -12,9 +12,39 @@ int Heap_ProcessInitialize(Process *proc, uint32_t heap_start_va);
 int Heap_ProcessBrk(Process *proc, void *addr);
 void *Heap_ProcessSbrk(Process *proc, intptr_t inc);
 
+/* Populate the heap page containing fault_addr with a zeroed frame.
+ * Returns false if the address is outside the process break.
+ */
+bool Heap_ProcessHandleFault(Process *proc, uint32_t fault_addr);
+
 /* Heap / allocator initialization */
 void Heap_Initialize(void);
 
+/* Number of slab size classes served by kmalloc */
+#define HEAP_SIZE_CLASSES 15
+
+/* Per-size-class allocator statistics */
+typedef struct
+{
+   uint32_t object_size; /* Slot size in bytes */
+   uint32_t slabs;       /* Slab pages owned by this class */
+   uint32_t in_use;      /* Live objects */
+   uint32_t free;        /* Free slots across the class's slabs */
+} HeapClassStats;
+
+/* Kernel heap statistics, see heap_stats() */
+typedef struct
+{
+   uint32_t arena_bytes;      /* Size of the kernel heap arena */
+   uint32_t committed_bytes;  /* Pages in use by slabs and large blocks */
+   uint32_t live_bytes;       /* Bytes currently handed out to callers */
+   uint32_t free_run_bytes;   /* Freed pages waiting below the break */
+   uint32_t largest_free_run; /* Largest free run (or wilderness) in bytes */
+   uint32_t large_allocs;     /* Live page-granular allocations */
+   uint32_t fragmentation;    /* Committed bytes not live, in percent */
+   HeapClassStats classes[HEAP_SIZE_CLASSES];
+} HeapStats;
+
 /* Core allocators */
 void *kmalloc(size_t size);
 void *kzalloc(size_t size);
@@ -31,6 +61,10 @@ void *realloc(void *ptr, size_t size);
 int brk(void *addr);      /* returns 0 on success, -1 on failure */
 void *sbrk(intptr_t inc); /* returns previous break or (void*)-1 on failure */
 
+/* Statistics */
+void heap_stats(HeapStats *out);
+void heap_print_stats(void);
+
 /* Self-test helper */
 void heap_self_test(void);
 
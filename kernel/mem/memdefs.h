@@ -31,10 +31,21 @@
 
 #define MEMORY_KERNEL_ADDR ((void *)0x00A00000)
 
+// Physical memory below this limit is identity mapped in every page directory
+#define IDENTITY_MAP_LIMIT 0x4000000u // 64 MiB
+
+// Kernel heap arena: from the end of the kernel image (__end) up to the
+// dylib memory pool. Identity mapped, so it is usable before paging/PMM.
+#define KERNEL_HEAP_LIMIT 0x1000000
+
 // Dylib memory configuration (10 MiB reserved)
 #define DYLIB_MEMORY_ADDR 0x1000000 // Base address for dylib memory pool
 #define DYLIB_MEMORY_SIZE 0xA00000  // 10 MiB reserved for dylibs
 
+// PMM per-frame metadata array, placed right after the dylib pool inside the
+// identity-mapped window (12 bytes per 4 KiB frame, 12 MiB for 4 GiB of RAM)
+#define PMM_MEMMAP_ADDR (DYLIB_MEMORY_ADDR + DYLIB_MEMORY_SIZE)
+
 // Library registry placed in low memory (inside FAT area). Stage2 populates
 // this with loaded modules so the kernel can find them.
 #define LIB_NAME_MAX 32
@@ -51,6 +62,7 @@ typedef struct
 
 #define BUFFER_LINES 2048
 #define BUFFER_BASE_ADDR 0x00800000
+#define BUFFER_SIZE (BUFFER_LINES * 80) // 80-column text lines
 
 #define SYS_INFO_ADDR 0x0087D000
 
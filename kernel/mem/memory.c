@@ -19,7 +19,7 @@
  */
 int memory_debug = 0;
 
-/* Called from assembly on memory faults (overflow/null/unsafe).
+/* Called by the memory wrappers on faults (address wrap).
  * Parameters (cdecl): void *addr, size_t len, int code
  * code: 1=memcpy fault, 2=memcmp fault, 3=memset fault
  */
@@ -36,26 +36,99 @@ void mem_fault_handler(void *addr, size_t len, int code)
 }
 
 /* Basic memory helpers */
-/* We implement the hot paths `memcpy` and `memcmp` in assembly for
- * performance. The assembly provides `memcpy_asm` and `memcmp_asm`;
- * here we provide small C wrappers that forward to those symbols.
+/* The hot paths `memcpy`, `memset` and `memcmp` are implemented in assembly
+ * (memory_asm.S) in several variants; mem_select_routines() picks the best
+ * one for the CPU at boot. The C wrappers keep the argument checks: NULL
+ * pointers are a no-op and address wrap is reported to mem_fault_handler.
  */
-extern void *memcpy_asm(void *dst, const void *src, size_t num);
+typedef void *(*MemcpyFn)(void *dst, const void *src, size_t num);
+typedef void *(*MemsetFn)(void *ptr, int value, size_t num);
+typedef int (*MemcmpFn)(const void *ptr1, const void *ptr2, size_t num);
+
+extern void *memcpy_dword_asm(void *dst, const void *src, size_t num);
+extern void *memcpy_erms_asm(void *dst, const void *src, size_t num);
+extern void *memcpy_sse2_asm(void *dst, const void *src, size_t num);
+extern void *memmove_backward_asm(void *dst, const void *src, size_t num);
+extern void *memset_dword_asm(void *ptr, int value, size_t num);
+extern void *memset_erms_asm(void *ptr, int value, size_t num);
+extern void *memset_sse2_asm(void *ptr, int value, size_t num);
+extern int memcmp_dword_asm(const void *ptr1, const void *ptr2, size_t num);
+extern int memcmp_sse2_asm(const void *ptr1, const void *ptr2, size_t num);
+extern void sse_enable_asm(void);
+
+/* Baseline variants until the CPU has been probed */
+static MemcpyFn memcpy_impl = memcpy_dword_asm;
+static MemsetFn memset_impl = memset_dword_asm;
+static MemcmpFn memcmp_impl = memcmp_dword_asm;
+static bool mem_sse_selected = false;
+
+#define CPUID_FEAT_TSC (1u << 4)
+#define CPUID_FEAT_SSE2 (1u << 26)
+#define CPUID_EXT_ERMS (1u << 9)
+
+static void mem_select_routines(void)
+{
+   uint32_t features = get_cpu_features();
+   uint32_t ext_features = get_cpu_ext_features();
+
+   if (features & CPUID_FEAT_SSE2)
+   {
+      sse_enable_asm();
+      mem_sse_selected = true;
+      memcpy_impl = memcpy_sse2_asm;
+      memset_impl = memset_sse2_asm;
+      memcmp_impl = memcmp_sse2_asm;
+   }
+   /* Fast-string microcode beats explicit vector loops for copies/fills */
+   if (ext_features & CPUID_EXT_ERMS)
+   {
+      memcpy_impl = memcpy_erms_asm;
+      memset_impl = memset_erms_asm;
+   }
+
+   printf("[mem] routines: memcpy/memset %s, memcmp %s\n",
+          (ext_features & CPUID_EXT_ERMS) ? "erms"
+          : (features & CPUID_FEAT_SSE2)  ? "sse2"
+                                          : "dword",
+          (features & CPUID_FEAT_SSE2) ? "sse2" : "dword");
+}
+
+bool mem_uses_sse(void) { return mem_sse_selected; }
+
+/* Reject NULL; report ranges that wrap the address space */
+static inline bool mem_range_ok(const void *ptr, size_t num, int code)
+{
+   if (!ptr) return false;
+   if ((uintptr_t)ptr + num < (uintptr_t)ptr)
+   {
+      mem_fault_handler((void *)ptr, num, code);
+      return false;
+   }
+   return true;
+}
+
 void *memcpy(void *dst, const void *src, size_t num)
 {
-   return memcpy_asm(dst, src, num);
+   if (num == 0 || !mem_range_ok(src, num, 1) || !mem_range_ok(dst, num, 1))
+      return dst;
+
+   /* Overlap with dst above src still copies correctly (memmove semantics) */
+   if ((uintptr_t)dst > (uintptr_t)src && (uintptr_t)dst < (uintptr_t)src + num)
+      return memmove_backward_asm(dst, src, num);
+   return memcpy_impl(dst, src, num);
 }
 
-extern void *memset_asm(void *ptr, int value, size_t num);
 void *memset(void *ptr, int value, size_t num)
 {
-   return memset_asm(ptr, value, num);
+   if (num == 0 || !mem_range_ok(ptr, num, 3)) return ptr;
+   return memset_impl(ptr, value, num);
 }
 
-extern int memcmp_asm(const void *ptr1, const void *ptr2, size_t num);
 int memcmp(const void *ptr1, const void *ptr2, size_t num)
 {
-   return memcmp_asm(ptr1, ptr2, num);
+   if (num == 0 || !mem_range_ok(ptr1, num, 2) || !mem_range_ok(ptr2, num, 2))
+      return 0;
+   return memcmp_impl(ptr1, ptr2, num);
 }
 
 void *SegmentOffsetToLinear(void *addr)
@@ -67,101 +140,193 @@ void *SegmentOffsetToLinear(void *addr)
 
 void *memmove(void *dest, const void *src, size_t n)
 {
-   char *d = (char *)dest;
-   const char *s = (const char *)src;
-
-   if (d == s || n == 0)
+   if (dest == src || n == 0)
    {
       return dest; // No copy needed if same or zero bytes
    }
 
-   if (d < s)
+   // Forward copies are safe unless dest starts inside the source range;
+   // that case is copied from the end.
+   uintptr_t d = (uintptr_t)dest;
+   uintptr_t s = (uintptr_t)src;
+   if (d < s || d >= s + n) return memcpy_impl(dest, src, n);
+   return memmove_backward_asm(dest, src, n);
+}
+
+static inline uint32_t mem_rdtsc(void)
+{
+   uint32_t lo, hi;
+   __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+   return lo;
+}
+
+/* Print throughput as bytes/cycle with two decimals */
+static void mem_bench_report(const char *name, uint32_t size, uint32_t bytes,
+                             uint32_t cycles)
+{
+   uint32_t centi = cycles ? (uint32_t)(((uint64_t)bytes * 100) / cycles) : 0;
+   printf("[mem] bench %s %u: %u.%02u bytes/cycle\n", name, size, centi / 100,
+          centi % 100);
+}
+
+void mem_benchmark(void)
+{
+   static const uint32_t sizes[] = {16, 64, 256, 1024, 4096, 16384, 65536};
+   const uint32_t max_size = 65536;
+   const uint32_t bytes_per_class = 1024 * 1024;
+
+   if (!(get_cpu_features() & CPUID_FEAT_TSC))
+   {
+      printf("[mem] bench: no TSC, skipped\n");
+      return;
+   }
+
+   uint8_t *a = kmalloc(max_size);
+   uint8_t *b = kmalloc(max_size);
+   if (!a || !b)
    {
-      // Destination is before source, copy forwards
-      for (size_t i = 0; i < n; ++i)
-      {
-         d[i] = s[i];
-      }
+      printf("[mem] bench: allocation failed\n");
+      free(a);
+      free(b);
+      return;
    }
-   else
+   memset(a, 0x5A, max_size);
+   memset(b, 0x5A, max_size);
+
+   for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i)
    {
-      // Destination is after source, or overlaps in a way that requires
-      // copying backwards to avoid overwriting source data before it's read.
-      for (size_t i = n; i > 0; --i)
-      {
-         d[i - 1] = s[i - 1];
-      }
+      uint32_t size = sizes[i];
+      uint32_t iters = bytes_per_class / size;
+
+      uint32_t t0 = mem_rdtsc();
+      for (uint32_t k = 0; k < iters; ++k) memcpy(b, a, size);
+      uint32_t t1 = mem_rdtsc();
+      for (uint32_t k = 0; k < iters; ++k) memset(b, (int)k, size);
+      uint32_t t2 = mem_rdtsc();
+      memcpy(b, a, size);
+      for (uint32_t k = 0; k < iters; ++k) (void)memcmp(a, b, size);
+      uint32_t t3 = mem_rdtsc();
+
+      mem_bench_report("memcpy", size, iters * size, t1 - t0);
+      mem_bench_report("memset", size, iters * size, t2 - t1);
+      mem_bench_report("memcmp", size, iters * size, t3 - t2);
    }
-   return dest;
+
+   free(a);
+   free(b);
+}
+
+/* Linker-provided bounds of the kernel image */
+extern uint8_t __entry_start;
+extern uint8_t __end;
+
+/* Fallback when the bootloader passed no usable memory information */
+#define DEFAULT_MEMORY_SIZE (256u * 1024 * 1024)
+
+/* Highest physical address tracked by the PMM (frames above 4 GiB are
+ * unreachable without PAE)
+ */
+#define MEMORY_TOP_LIMIT 0xFFFFF000ull
+
+static bool multiboot_has_mmap(multiboot_info_t *mbi)
+{
+   /* Check if memory map is available (flags bit 6) and sane */
+   return (mbi->flags & 0x40) && mbi->mmap_addr >= 0x1000 &&
+          mbi->mmap_addr <= 0x100000;
+}
+
+static multiboot_mmap_entry_t *multiboot_mmap_next(multiboot_mmap_entry_t *e)
+{
+   return (multiboot_mmap_entry_t *)((uint32_t)e + e->size + sizeof(e->size));
 }
 
 /**
- * Parse Multiboot memory map to detect total system memory
- * Returns total memory in bytes
+ * Parse Multiboot memory info to find the top of usable RAM
+ * Returns the end address of the highest available region in bytes
  */
 static uint32_t parse_multiboot_memory(multiboot_info_t *mbi)
 {
-   uint32_t total_mem = 0;
-   const uint32_t default_mem = 256 * 1024 * 1024; /* Default: 256 MB */
+   uint64_t top = 0;
 
    /* Validate pointer is in a reasonable range */
    if (!mbi || (uint32_t)mbi < 0x1000 || (uint32_t)mbi > 0x100000)
    {
-      return default_mem;
-   }
-
-   /* Check if memory info is available (flags bit 0) */
-   if (mbi->flags & 0x01)
-   {
-      /* mem_lower = KB below 1MB, mem_upper = KB above 1MB */
-      total_mem = (mbi->mem_lower + mbi->mem_upper) * 1024;
-      /* Sanity check: memory should be at least 16MB and less than 64GB */
-      if (total_mem >= 16 * 1024 * 1024 && total_mem <= 0xFFFFFFFF)
-      {
-         return total_mem;
-      }
+      return DEFAULT_MEMORY_SIZE;
    }
 
-   /* Check if memory map is available (flags bit 6) */
-   if (mbi->flags & 0x40)
+   if (multiboot_has_mmap(mbi))
    {
-      /* Validate mmap_addr is reasonable */
-      if (mbi->mmap_addr < 0x1000 || mbi->mmap_addr > 0x100000)
-      {
-         return default_mem;
-      }
-
       multiboot_mmap_entry_t *mmap = (multiboot_mmap_entry_t *)mbi->mmap_addr;
       multiboot_mmap_entry_t *mmap_end =
           (multiboot_mmap_entry_t *)(mbi->mmap_addr + mbi->mmap_length);
 
-      while (mmap < mmap_end)
+      for (; mmap < mmap_end; mmap = multiboot_mmap_next(mmap))
       {
-         if (mmap->type == 1) /* Available RAM */
+         if (mmap->type == 1 && mmap->base_addr + mmap->length > top)
          {
-            uint64_t region_end = mmap->base_addr + mmap->length;
-            if (region_end > total_mem)
-            {
-               total_mem = (uint32_t)region_end;
-            }
+            top = mmap->base_addr + mmap->length;
          }
-         mmap = (multiboot_mmap_entry_t *)((uint32_t)mmap + mmap->size +
-                                           sizeof(mmap->size));
       }
+   }
+   else if (mbi->flags & 0x01)
+   {
+      /* mem_upper = KB above 1MB */
+      top = 0x100000ull + (uint64_t)mbi->mem_upper * 1024;
+   }
 
-      /* Sanity check result */
-      if (total_mem >= 16 * 1024 * 1024 && total_mem <= 0xFFFFFFFF)
+   if (top > MEMORY_TOP_LIMIT) top = MEMORY_TOP_LIMIT;
+
+   /* Sanity check: memory should be at least 16MB */
+   if (top < 16 * 1024 * 1024) return DEFAULT_MEMORY_SIZE;
+   return (uint32_t)top;
+}
+
+/**
+ * Hand every available region from the Multiboot info to the PMM, then
+ * reserve the ranges the kernel already occupies.
+ */
+static void register_physical_memory(multiboot_info_t *mbi, uint32_t top)
+{
+   bool valid = mbi && (uint32_t)mbi >= 0x1000 && (uint32_t)mbi <= 0x100000;
+
+   if (valid && multiboot_has_mmap(mbi))
+   {
+      multiboot_mmap_entry_t *mmap = (multiboot_mmap_entry_t *)mbi->mmap_addr;
+      multiboot_mmap_entry_t *mmap_end =
+          (multiboot_mmap_entry_t *)(mbi->mmap_addr + mbi->mmap_length);
+
+      for (; mmap < mmap_end; mmap = multiboot_mmap_next(mmap))
       {
-         return total_mem;
+         if (mmap->type == 1) PMM_AddRegion(mmap->base_addr, mmap->length);
       }
    }
+   else if (valid && (mbi->flags & 0x01))
+   {
+      PMM_AddRegion(0, (uint64_t)mbi->mem_lower * 1024);
+      PMM_AddRegion(0x100000, (uint64_t)mbi->mem_upper * 1024);
+   }
+   else
+   {
+      PMM_AddRegion(0x100000, top - 0x100000);
+   }
 
-   /* No valid memory info available, use default */
-   return default_mem;
+   /* Real-mode area: IVT, BDA, stage2, FAT scratch, EBDA, video, BIOS */
+   PMM_ReserveRegion(0, 0x100000);
+   /* Scrollback buffer and system info page */
+   PMM_ReserveRegion(BUFFER_BASE_ADDR, BUFFER_SIZE);
+   PMM_ReserveRegion(SYS_INFO_ADDR, PAGE_SIZE);
+   /* Kernel image and the kernel heap arena that follows it */
+   PMM_ReserveRegion((uint32_t)&__entry_start,
+                     (uint32_t)&__end - (uint32_t)&__entry_start);
+   PMM_ReserveRegion((uint32_t)&__end, KERNEL_HEAP_LIMIT - (uint32_t)&__end);
+   /* Dynamic library pool */
+   PMM_ReserveRegion(DYLIB_MEMORY_ADDR, DYLIB_MEMORY_SIZE);
 }
 
 void MEM_Initialize(void *multiboot_info_ptr)
 {
+   mem_select_routines();
+
    /* Detect total memory from Multiboot info */
    uint32_t total_memory =
        parse_multiboot_memory((multiboot_info_t *)multiboot_info_ptr);
@@ -170,21 +335,31 @@ void MEM_Initialize(void *multiboot_info_ptr)
    heap_self_test();
    Stack_Initialize();
    stack_self_test();
-   HAL_Paging_Initialize();
-   HAL_Paging_SelfTest();
 
-   // Initialize physical and virtual memory managers
+   // The PMM runs before paging is enabled: page tables come from it
    PMM_Initialize(total_memory);
+   register_physical_memory((multiboot_info_t *)multiboot_info_ptr,
+                            total_memory);
+   PMM_PrintStats();
    pmm_self_test();
+
+   HAL_Paging_Initialize();
+   HAL_Paging_SelfTest();
    VMM_Initialize();
    vmm_self_test();
+#ifdef DEBUG
+   mem_benchmark();
+#endif
 
    /* Populate memory info in SYS_Info */
    g_SysInfo->memory.total_memory = total_memory;
    g_SysInfo->memory.page_size = PAGE_SIZE;
-   g_SysInfo->memory.kernel_start = (uint32_t)0x00A00000;
-   g_SysInfo->memory.kernel_end =
-       g_SysInfo->memory.kernel_start + 0x100000; /* Approximate */
+   g_SysInfo->memory.heap_start = (uint32_t)mem_heap_start();
+   g_SysInfo->memory.heap_end = (uint32_t)mem_heap_end();
+   g_SysInfo->memory.heap_size =
+       g_SysInfo->memory.heap_end - g_SysInfo->memory.heap_start;
+   g_SysInfo->memory.kernel_start = (uint32_t)&__entry_start;
+   g_SysInfo->memory.kernel_end = (uint32_t)&__end;
    g_SysInfo->memory.user_start = (uint32_t)0x08000000;
    g_SysInfo->memory.user_end = (uint32_t)0xC0000000;
    g_SysInfo->memory.kernel_stack_size = 8192; /* 8KB kernel stack */
@@ -3,6 +3,7 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -33,4 +34,13 @@ void *SegmentOffsetToLinear(void *addr);
 
 void MEM_Initialize(void *multiboot_info_ptr);
 
+/* True once the SSE2 mem* variants are selected; XMM registers are then live
+ * inside kernel copies and exception handlers that may copy must preserve
+ * them (see i686_Paging_PageFaultIsr)
+ */
+bool mem_uses_sse(void);
+
+/* Print memcpy/memset/memcmp throughput per size class (needs TSC) */
+void mem_benchmark(void);
+
 #endif
\ No newline at end of file
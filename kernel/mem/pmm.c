@@ -2,119 +2,394 @@
 
 #include "pmm.h"
 #include "memory.h"
+#include <hal/paging.h>
 #include <mem/memdefs.h>
 #include <std/stdio.h>
 #include <stddef.h>
 #include <stdint.h>
 
-#define BITS_PER_BYTE 8
+#define PMM_NONE 0xFFFFFFFFu
 
-/* Bitmap to track free/allocated pages
- * bit=0: free, bit=1: allocated
- * We allocate the bitmap itself from identity-mapped kernel space
+/* Page flags */
+#define PMM_PAGE_FREE 0x01     /* head of a block on a free list */
+#define PMM_PAGE_RESERVED 0x02 /* never handed out (firmware, kernel, ...) */
+
+/* Per-frame metadata. Free blocks are kept on doubly linked per-order lists
+ * threaded through the metadata of their head frame, so frames themselves
+ * never have to be mapped to be tracked.
+ */
+typedef struct
+{
+   uint32_t next;
+   uint32_t prev;
+   uint8_t order;
+   uint8_t flags;
+   uint16_t refs; /* extra mappings sharing the frame (copy-on-write) */
+} PMM_Page;
+
+typedef struct
+{
+   uint32_t head;
+   uint32_t count;
+} PMM_FreeArea;
+
+/* Free lists are split into two zones at IDENTITY_MAP_LIMIT: frames below it
+ * can be dereferenced directly by the kernel (page tables, DMA descriptors),
+ * frames above it are only reachable through a mapping. The boundary is
+ * aligned to the largest order, so buddies never straddle it.
  */
-static uint8_t *page_bitmap = NULL;
+#define PMM_ZONE_LOW 0
+#define PMM_ZONE_HIGH 1
+#define PMM_ZONE_COUNT 2
+#define PMM_LOW_PAGES (IDENTITY_MAP_LIMIT / PAGE_SIZE)
+
+static PMM_Page *page_map = NULL;
+static PMM_FreeArea free_area[PMM_ZONE_COUNT][PMM_MAX_ORDER + 1];
 static uint32_t total_pages = 0;
 static uint32_t allocated_count = 0;
+static uint32_t map_start = 0, map_end = 0; /* frames holding page_map */
+
+/* Frames zeroed ahead of time by PMM_RefillZeroPool(); they count as
+ * allocated and are handed back to the buddy lists under memory pressure.
+ */
+static uint32_t zero_pool[PMM_ZERO_POOL_SIZE];
+static uint32_t zero_pool_count = 0;
 
-static void bitmap_set(uint32_t page_idx)
+static inline PMM_FreeArea *area_of(uint32_t idx, uint32_t order)
 {
-   uint32_t byte_idx = page_idx / BITS_PER_BYTE;
-   uint32_t bit_idx = page_idx % BITS_PER_BYTE;
-   page_bitmap[byte_idx] |= (1u << bit_idx);
-   allocated_count++;
+   return &free_area[idx < PMM_LOW_PAGES ? PMM_ZONE_LOW : PMM_ZONE_HIGH]
+                    [order];
 }
 
-static void bitmap_clear(uint32_t page_idx)
+static void free_list_push(uint32_t idx, uint32_t order)
 {
-   uint32_t byte_idx = page_idx / BITS_PER_BYTE;
-   uint32_t bit_idx = page_idx % BITS_PER_BYTE;
-   page_bitmap[byte_idx] &= ~(1u << bit_idx);
-   if (allocated_count > 0) allocated_count--;
+   PMM_FreeArea *area = area_of(idx, order);
+   PMM_Page *pg = &page_map[idx];
+   pg->order = (uint8_t)order;
+   pg->flags = PMM_PAGE_FREE;
+   pg->prev = PMM_NONE;
+   pg->next = area->head;
+   if (pg->next != PMM_NONE) page_map[pg->next].prev = idx;
+   area->head = idx;
+   area->count++;
 }
 
-static bool bitmap_is_set(uint32_t page_idx)
+static void free_list_remove(uint32_t idx, uint32_t order)
 {
-   uint32_t byte_idx = page_idx / BITS_PER_BYTE;
-   uint32_t bit_idx = page_idx % BITS_PER_BYTE;
-   return (page_bitmap[byte_idx] & (1u << bit_idx)) != 0;
+   PMM_FreeArea *area = area_of(idx, order);
+   PMM_Page *pg = &page_map[idx];
+   if (pg->prev != PMM_NONE)
+      page_map[pg->prev].next = pg->next;
+   else
+      area->head = pg->next;
+   if (pg->next != PMM_NONE) page_map[pg->next].prev = pg->prev;
+   pg->next = pg->prev = PMM_NONE;
+   pg->flags &= ~PMM_PAGE_FREE;
+   area->count--;
 }
 
-void PMM_Initialize(uint32_t total_mem_bytes)
+/* Return the head of the free block covering idx, or PMM_NONE */
+static uint32_t find_free_block(uint32_t idx)
 {
-   // Calculate number of pages
-   total_pages = (total_mem_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+   for (uint32_t order = 0; order <= PMM_MAX_ORDER; ++order)
+   {
+      uint32_t head = idx & ~((1u << order) - 1);
+      PMM_Page *pg = &page_map[head];
+      if ((pg->flags & PMM_PAGE_FREE) && pg->order >= order) return head;
+   }
+   return PMM_NONE;
+}
+
+/* Release a block to the buddy lists, merging with free buddies */
+static void buddy_free(uint32_t idx, uint32_t order)
+{
+   while (order < PMM_MAX_ORDER)
+   {
+      uint32_t buddy = idx ^ (1u << order);
+      if (buddy >= total_pages) break;
+
+      PMM_Page *bp = &page_map[buddy];
+      if (!(bp->flags & PMM_PAGE_FREE) || bp->order != order) break;
+
+      free_list_remove(buddy, order);
+      idx &= ~(1u << order);
+      order++;
+   }
+   free_list_push(idx, order);
+}
 
-   // Bitmap size in bytes
-   uint32_t bitmap_bytes = (total_pages + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+static uint32_t buddy_alloc(uint32_t order, int zone)
+{
+   uint32_t o = order;
+   while (o <= PMM_MAX_ORDER && free_area[zone][o].head == PMM_NONE) o++;
+   if (o > PMM_MAX_ORDER) return PMM_NONE;
 
-   // Allocate bitmap from lower memory (identity-mapped)
-   // For now, use a static buffer to avoid chicken-and-egg
-   // In a real system, you'd place this in a reserved region
-   static uint8_t bitmap_storage[131072]; // max ~1M pages (4 GiB)
-   page_bitmap = bitmap_storage;
+   uint32_t idx = free_area[zone][o].head;
+   free_list_remove(idx, o);
 
-   if (bitmap_bytes > sizeof(bitmap_storage))
+   /* split down, returning the upper halves */
+   while (o > order)
    {
-      printf("[pmm] WARNING: bitmap too small for %u pages\n", total_pages);
-      total_pages = sizeof(bitmap_storage) * BITS_PER_BYTE;
-      bitmap_bytes = sizeof(bitmap_storage);
+      o--;
+      free_list_push(idx + (1u << o), o);
    }
 
-   // Initially all pages are free (bitmap = 0)
-   memset(page_bitmap, 0, bitmap_bytes);
-   allocated_count = 0;
+   page_map[idx].order = (uint8_t)order;
+   return idx;
+}
 
-   // Reserve pages 0-2 MiB for kernel/boot (0x00000 - 0x200000)
-   uint32_t reserved_pages = (2 * 1024 * 1024) / PAGE_SIZE;
-   for (uint32_t i = 0; i < reserved_pages && i < total_pages; ++i)
+/* Hand the frames [start, end) to the allocator in maximal aligned blocks */
+static void free_range(uint32_t start, uint32_t end)
+{
+   while (start < end)
    {
-      bitmap_set(i);
+      uint32_t order = PMM_MAX_ORDER;
+      while (order > 0 &&
+             ((start & ((1u << order) - 1)) || start + (1u << order) > end))
+         order--;
+
+      for (uint32_t i = 0; i < (1u << order); ++i)
+         page_map[start + i].flags &= ~PMM_PAGE_RESERVED;
+      allocated_count -= 1u << order;
+      buddy_free(start, order);
+      start += 1u << order;
    }
+}
+
+/* Pull a single free frame out of whatever free block covers it, splitting
+ * the block so the remaining halves stay on the free lists.
+ */
+static void take_frame(uint32_t idx)
+{
+   uint32_t head = find_free_block(idx);
+   if (head == PMM_NONE) return;
 
-   printf("[pmm] init: total=%u pages, reserved=%u, free=%u\n", total_pages,
-          reserved_pages, total_pages - allocated_count);
+   uint32_t order = page_map[head].order;
+   free_list_remove(head, order);
+   while (order > 0)
+   {
+      order--;
+      uint32_t half = 1u << order;
+      if (idx < head + half)
+      {
+         free_list_push(head + half, order);
+      }
+      else
+      {
+         free_list_push(head, order);
+         head += half;
+      }
+   }
+
+   page_map[idx].order = 0;
+   page_map[idx].flags = PMM_PAGE_RESERVED;
+   allocated_count++;
 }
 
-uint32_t PMM_AllocatePhysicalPage(void)
+void PMM_Initialize(uint32_t total_mem_bytes)
 {
-   if (!page_bitmap) return 0;
+   // Calculate number of pages
+   total_pages = total_mem_bytes / PAGE_SIZE;
+
+   // Frame metadata lives in a fixed identity-mapped region after the dylib
+   // pool; the frames it occupies are never released by PMM_AddRegion().
+   page_map = (PMM_Page *)PMM_MEMMAP_ADDR;
+   map_start = PMM_MEMMAP_ADDR / PAGE_SIZE;
+   map_end = (PMM_MEMMAP_ADDR + total_pages * sizeof(PMM_Page) + PAGE_SIZE -
+              1) /
+             PAGE_SIZE;
 
-   // Simple linear search for a free page
+   if (map_end > total_pages)
+   {
+      printf("[pmm] WARNING: frame map at 0x%08x exceeds physical memory\n",
+             PMM_MEMMAP_ADDR);
+   }
+
+   // Every frame starts reserved; usable RAM is handed in via PMM_AddRegion
    for (uint32_t i = 0; i < total_pages; ++i)
    {
-      if (!bitmap_is_set(i))
+      page_map[i].next = page_map[i].prev = PMM_NONE;
+      page_map[i].order = 0;
+      page_map[i].flags = PMM_PAGE_RESERVED;
+      page_map[i].refs = 0;
+   }
+   for (int z = 0; z < PMM_ZONE_COUNT; ++z)
+   {
+      for (uint32_t o = 0; o <= PMM_MAX_ORDER; ++o)
       {
-         bitmap_set(i);
-         return i * PAGE_SIZE;
+         free_area[z][o].head = PMM_NONE;
+         free_area[z][o].count = 0;
       }
    }
+   allocated_count = total_pages;
+}
+
+void PMM_AddRegion(uint64_t base, uint64_t length)
+{
+   if (!page_map || length == 0) return;
+
+   // Only whole frames inside the region are usable
+   uint64_t first = (base + PAGE_SIZE - 1) / PAGE_SIZE;
+   uint64_t last = (base + length) / PAGE_SIZE;
+   if (last > total_pages) last = total_pages;
+   if (first >= last) return;
+
+   // Release runs of still-reserved frames, skipping the frame map itself and
+   // anything an overlapping region has already released
+   uint32_t run = PMM_NONE;
+   for (uint32_t i = (uint32_t)first; i <= (uint32_t)last; ++i)
+   {
+      bool usable = i < last && (i < map_start || i >= map_end) &&
+                    (page_map[i].flags & PMM_PAGE_RESERVED);
+      if (usable && run == PMM_NONE)
+      {
+         run = i;
+      }
+      else if (!usable && run != PMM_NONE)
+      {
+         free_range(run, i);
+         run = PMM_NONE;
+      }
+   }
+}
+
+void PMM_ReserveRegion(uint32_t base, uint32_t length)
+{
+   if (!page_map || length == 0) return;
+
+   uint32_t first = base / PAGE_SIZE;
+   uint64_t last = ((uint64_t)base + length + PAGE_SIZE - 1) / PAGE_SIZE;
+   if (last > total_pages) last = total_pages;
+
+   for (uint32_t i = first; i < last; ++i) take_frame(i);
+}
+
+void PMM_PrintStats(void)
+{
+   printf("[pmm] total=%u pages, reserved/used=%u, free=%u\n", total_pages,
+          allocated_count, total_pages - allocated_count);
+}
+
+uint32_t PMM_AllocatePhysicalPage(void) { return PMM_AllocateContiguous(0); }
+
+uint32_t PMM_AllocateLowPage(void) { return PMM_AllocateLowContiguous(0); }
+
+static uint32_t alloc_in_zones(uint32_t order, bool low_only)
+{
+   if (!page_map || order > PMM_MAX_ORDER) return 0;
+
+   // Keep the directly addressable low zone for callers that need it
+   uint32_t idx = low_only ? PMM_NONE : buddy_alloc(order, PMM_ZONE_HIGH);
+   if (idx == PMM_NONE) idx = buddy_alloc(order, PMM_ZONE_LOW);
+   if (idx == PMM_NONE && zero_pool_count > 0)
+   {
+      // Give the pre-zeroed frames back before failing
+      while (zero_pool_count > 0)
+         PMM_FreePhysicalPage(zero_pool[--zero_pool_count]);
+      return alloc_in_zones(order, low_only);
+   }
+   if (idx == PMM_NONE)
+   {
+      printf("[pmm] out of memory (order %u%s)\n", order,
+             low_only ? ", low" : "");
+      return 0;
+   }
+
+   allocated_count += 1u << order;
+   return idx * PAGE_SIZE;
+}
+
+uint32_t PMM_AllocateContiguous(uint32_t order)
+{
+   return alloc_in_zones(order, false);
+}
 
-   printf("[pmm] PMM_AllocatePhysicalPage: out of memory\n");
-   return 0;
+uint32_t PMM_AllocateLowContiguous(uint32_t order)
+{
+   return alloc_in_zones(order, true);
 }
 
-void PMM_FreePhysicalPage(uint32_t addr)
+uint32_t PMM_AllocateZeroedPage(void)
 {
-   if (!page_bitmap || (addr % PAGE_SIZE) != 0) return;
+   if (zero_pool_count > 0) return zero_pool[--zero_pool_count];
+
+   uint32_t addr = PMM_AllocatePhysicalPage();
+   if (addr) HAL_Paging_ZeroPhysicalPage(addr);
+   return addr;
+}
+
+uint32_t PMM_RefillZeroPool(uint32_t max_pages)
+{
+   uint32_t added = 0;
+   while (added < max_pages && zero_pool_count < PMM_ZERO_POOL_SIZE)
+   {
+      // Leave headroom so the pool never causes an allocation to fail
+      if (PMM_FreePages() <= PMM_ZERO_POOL_SIZE * 4) break;
+
+      uint32_t addr = PMM_AllocatePhysicalPage();
+      if (!addr) break;
+      HAL_Paging_ZeroPhysicalPage(addr);
+      zero_pool[zero_pool_count++] = addr;
+      added++;
+   }
+   return added;
+}
+
+uint32_t PMM_ZeroPoolCount(void) { return zero_pool_count; }
+
+void PMM_FreePhysicalPage(uint32_t addr) { PMM_FreeContiguous(addr, 0); }
+
+void PMM_FreeContiguous(uint32_t addr, uint32_t order)
+{
+   if (!page_map || (addr % PAGE_SIZE) != 0 || order > PMM_MAX_ORDER) return;
 
    uint32_t page_idx = addr / PAGE_SIZE;
-   if (page_idx >= total_pages) return;
+   if (page_idx & ((1u << order) - 1)) return;
+   if (page_idx + (1u << order) > total_pages) return;
 
-   if (bitmap_is_set(page_idx))
+   if (page_map[page_idx].flags & PMM_PAGE_RESERVED) return;
+   if (find_free_block(page_idx) != PMM_NONE)
    {
-      bitmap_clear(page_idx);
+      printf("[pmm] double free of 0x%08x\n", addr);
+      return;
    }
+
+   // A shared frame only loses one reference
+   if (order == 0 && page_map[page_idx].refs > 0)
+   {
+      page_map[page_idx].refs--;
+      return;
+   }
+
+   allocated_count -= 1u << order;
+   buddy_free(page_idx, order);
+}
+
+void PMM_RefPage(uint32_t addr)
+{
+   uint32_t page_idx = addr / PAGE_SIZE;
+   if (!page_map || page_idx >= total_pages) return;
+   if (page_map[page_idx].flags & PMM_PAGE_RESERVED) return;
+   page_map[page_idx].refs++;
+}
+
+uint32_t PMM_PageRefCount(uint32_t addr)
+{
+   uint32_t page_idx = addr / PAGE_SIZE;
+   if (!page_map || page_idx >= total_pages) return 0;
+   if (page_map[page_idx].flags & PMM_PAGE_RESERVED) return 0;
+   if (find_free_block(page_idx) != PMM_NONE) return 0;
+   return page_map[page_idx].refs + 1u;
 }
 
 bool PMM_IsPhysicalPageFree(uint32_t addr)
 {
-   if (!page_bitmap || (addr % PAGE_SIZE) != 0) return false;
+   if (!page_map || (addr % PAGE_SIZE) != 0) return false;
 
    uint32_t page_idx = addr / PAGE_SIZE;
    if (page_idx >= total_pages) return false;
 
-   return !bitmap_is_set(page_idx);
+   return find_free_block(page_idx) != PMM_NONE;
 }
 
 uint32_t PMM_TotalMemory(void) { return total_pages * PAGE_SIZE; }
@@ -167,5 +442,44 @@ void pmm_self_test(void)
       return;
    }
 
+   // Contiguous blocks are size-aligned and merge back on free
+   uint32_t free_before = PMM_FreePages();
+   uint32_t block = PMM_AllocateContiguous(4);
+   if (!block || (block % (PAGE_SIZE << 4)) != 0 ||
+       PMM_FreePages() != free_before - 16)
+   {
+      printf("[pmm] self-test: FAIL (contiguous order-4 block)\n");
+      return;
+   }
+   PMM_FreeContiguous(block, 4);
+   if (PMM_FreePages() != free_before || !PMM_IsPhysicalPageFree(block))
+   {
+      printf("[pmm] self-test: FAIL (contiguous free)\n");
+      return;
+   }
+
+   // The zero pool hands out the frames it prepared
+   uint32_t pooled = PMM_RefillZeroPool(2);
+   uint32_t z = PMM_AllocateZeroedPage();
+   if (!z || PMM_ZeroPoolCount() != pooled - (pooled ? 1 : 0))
+   {
+      printf("[pmm] self-test: FAIL (zero pool)\n");
+      return;
+   }
+   PMM_FreePhysicalPage(z);
+
+   // A shared page survives until its last reference is dropped
+   PMM_RefPage(p3);
+   PMM_FreePhysicalPage(p3);
+   if (PMM_IsPhysicalPageFree(p3) || PMM_PageRefCount(p3) != 1)
+   {
+      printf("[pmm] self-test: FAIL (refcount)\n");
+      return;
+   }
+
+   PMM_FreePhysicalPage(p1);
+   PMM_FreePhysicalPage(p2);
+   PMM_FreePhysicalPage(p3);
+
    printf("[pmm] self-test: PASS (allocated %u, freed, reallocated)\n", p1);
 }
@@ -9,26 +9,84 @@
 
 /* Physical Memory Manager (PMM)
  *
- * Tracks allocation of physical page frames.
+ * Tracks allocation of physical page frames with a binary buddy allocator.
  * Works with paging.c (which handles page table manipulation).
  */
 
-/* Initialize PMM with available physical memory
- * Call before any PMM_AllocatePhysicalPage() calls
- * Accepts memory ranges from multiboot info or hardcoded.
+/* Largest block order handed out: 2^10 pages = 4 MiB */
+#define PMM_MAX_ORDER 10
+
+/* Initialize PMM frame tracking for physical addresses [0, total_mem_bytes)
+ * Every frame starts out reserved; describe usable RAM with PMM_AddRegion()
+ * and carve out in-use ranges with PMM_ReserveRegion() before allocating.
  */
 void PMM_Initialize(uint32_t total_mem_bytes);
 
+/* Hand an available RAM region (e.g. a multiboot mmap type 1 entry) to the
+ * allocator. Partial frames at either end and anything beyond the tracked
+ * range are ignored; overlapping regions are harmless.
+ */
+void PMM_AddRegion(uint64_t base, uint64_t length);
+
+/* Mark a physical range as permanently in use (kernel image, firmware data,
+ * fixed buffers). Partial frames at either end are reserved whole.
+ */
+void PMM_ReserveRegion(uint32_t base, uint32_t length);
+
 /* Allocate a single 4K physical page frame
  * Returns physical address, or 0 on failure
  */
 uint32_t PMM_AllocatePhysicalPage(void);
 
+/* Allocate a 4K page frame that is already zeroed. Served from the pool
+ * refilled by PMM_RefillZeroPool() when possible, otherwise zeroed inline.
+ * Returns physical address, or 0 on failure
+ */
+uint32_t PMM_AllocateZeroedPage(void);
+
+/* Pre-zeroed page pool, refilled from the idle loop */
+#define PMM_ZERO_POOL_SIZE 64
+#define PMM_ZERO_POOL_BATCH 8
+
+/* Zero up to max_pages more frames into the pool.
+ * Returns the number of pages added.
+ */
+uint32_t PMM_RefillZeroPool(uint32_t max_pages);
+uint32_t PMM_ZeroPoolCount(void);
+
 /* Free a previously allocated physical page
  * addr should be page-aligned (4K)
  */
 void PMM_FreePhysicalPage(uint32_t addr);
 
+/* Allocate 2^order physically contiguous page frames (DMA buffers, large
+ * kernel mappings). The block is aligned to its own size.
+ * Returns physical address of the first frame, or 0 on failure
+ */
+uint32_t PMM_AllocateContiguous(uint32_t order);
+
+/* Same as PMM_AllocatePhysicalPage()/PMM_AllocateContiguous(), but the frames
+ * come from below IDENTITY_MAP_LIMIT so the physical address can be used as a
+ * kernel pointer directly (page tables, DMA descriptor tables).
+ */
+uint32_t PMM_AllocateLowPage(void);
+uint32_t PMM_AllocateLowContiguous(uint32_t order);
+
+/* Free a block obtained from PMM_AllocateContiguous() with the same order.
+ * Individual pages of a block may also be freed one by one with order 0.
+ */
+void PMM_FreeContiguous(uint32_t addr, uint32_t order);
+
+/* Add a reference to an allocated page shared by several mappings
+ * (copy-on-write). PMM_FreePhysicalPage() drops one reference and only
+ * releases the frame when the last one goes.
+ */
+void PMM_RefPage(uint32_t addr);
+
+/* Number of references to an allocated page, 0 if it is free or reserved
+ */
+uint32_t PMM_PageRefCount(uint32_t addr);
+
 /* Check if a physical page is free
  */
 bool PMM_IsPhysicalPageFree(uint32_t addr);
@@ -45,6 +103,10 @@ uint32_t PMM_FreePages(void);
  */
 uint32_t PMM_AllocatedPages(void);
 
+/* Print frame usage summary
+ */
+void PMM_PrintStats(void);
+
 /* Self-test helper
  */
 void pmm_self_test(void);
@@ -94,11 +94,11 @@ int Stack_ProcessInitialize(Process *proc, uint32_t stack_top_va, size_t size)
    for (uint32_t i = 0; i < pages_needed; ++i)
    {
       uint32_t va = stack_bottom_va + (i * PAGE_SIZE);
-      uint32_t phys = PMM_AllocatePhysicalPage();
+      uint32_t phys = PMM_AllocateZeroedPage();
 
       if (phys == 0)
       {
-         printf("[stack] ERROR: PMM_AllocatePhysicalPage failed\n");
+         printf("[stack] ERROR: PMM_AllocateZeroedPage failed\n");
          // Cleanup already mapped pages
          for (uint32_t j = 0; j < i; ++j)
          {
@@ -2,6 +2,8 @@
 
 #include "vmm.h"
 #include "pmm.h"
+#include <cpu/process.h>
+#include <mem/heap.h>
 #include <mem/memdefs.h>
 #include <mem/memory.h>
 #include <std/stdio.h>
@@ -14,13 +16,142 @@
 #define PAGE_ALIGN_UP(v) (((v) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
 
 static void *kernel_page_dir = NULL;
-static uint32_t kernel_next_vaddr =
-    0x80000000u; // Start at 2 GiB for kernel mappings
+static VMM_Arena kernel_arena; // kernel mappings live in [2 GiB, 3 GiB)
 
 #ifndef KERNEL_BASE
 #define KERNEL_BASE 0xC0000000u
 #endif
 
+#define VMM_KERNEL_ARENA_BASE 0x80000000u
+
+/* Free span of an arena; spans are kept sorted by address and never touch */
+struct VMM_Span
+{
+   uint32_t start;
+   uint32_t size;
+   struct VMM_Span *next;
+};
+
+void VMM_ArenaInitialize(VMM_Arena *arena, uint32_t base, uint32_t size)
+{
+   arena->base = base;
+   arena->size = size;
+   arena->free_list = NULL;
+   arena->free_bytes = 0;
+   VMM_ArenaFree(arena, base, size);
+}
+
+uint32_t VMM_ArenaAllocate(VMM_Arena *arena, uint32_t size, uint32_t align)
+{
+   if (!arena || size == 0) return 0;
+   if (align < PAGE_SIZE) align = PAGE_SIZE;
+   if (align & (align - 1)) return 0;
+
+   size = PAGE_ALIGN_UP(size);
+
+   // First fit: carve the aligned range out of the first span that holds it
+   VMM_Span **link = &arena->free_list;
+   for (VMM_Span *span = *link; span; link = &span->next, span = *link)
+   {
+      uint64_t span_end = (uint64_t)span->start + span->size;
+      uint64_t addr = ((uint64_t)span->start + align - 1) & ~(uint64_t)(align - 1);
+      if (addr + size > span_end) continue;
+
+      uint32_t front = (uint32_t)(addr - span->start);
+      uint32_t back = (uint32_t)(span_end - (addr + size));
+
+      if (front == 0 && back == 0)
+      {
+         *link = span->next;
+         free(span);
+      }
+      else if (front == 0)
+      {
+         span->start += size;
+         span->size = back;
+      }
+      else if (back == 0)
+      {
+         span->size = front;
+      }
+      else
+      {
+         VMM_Span *tail = (VMM_Span *)kmalloc(sizeof(VMM_Span));
+         if (!tail) return 0;
+         tail->start = (uint32_t)(addr + size);
+         tail->size = back;
+         tail->next = span->next;
+         span->size = front;
+         span->next = tail;
+      }
+
+      arena->free_bytes -= size;
+      return (uint32_t)addr;
+   }
+
+   return 0;
+}
+
+void VMM_ArenaFree(VMM_Arena *arena, uint32_t addr, uint32_t size)
+{
+   if (!arena || size == 0) return;
+   size = PAGE_ALIGN_UP(size);
+   uint32_t end = addr + size;
+
+   // Find the neighbours of the returned range
+   VMM_Span *prev = NULL;
+   VMM_Span *next = arena->free_list;
+   while (next && next->start < addr)
+   {
+      prev = next;
+      next = next->next;
+   }
+
+   if ((prev && prev->start + prev->size > addr) || (next && end > next->start))
+   {
+      printf("[vmm] arena free: range 0x%08x+0x%x overlaps free space\n", addr,
+             size);
+      return;
+   }
+
+   arena->free_bytes += size;
+
+   // Coalesce with either neighbour where the ranges touch
+   if (prev && prev->start + prev->size == addr)
+   {
+      prev->size += size;
+      if (next && end == next->start)
+      {
+         prev->size += next->size;
+         prev->next = next->next;
+         free(next);
+      }
+      return;
+   }
+   if (next && end == next->start)
+   {
+      next->start = addr;
+      next->size += size;
+      return;
+   }
+
+   VMM_Span *span = (VMM_Span *)kmalloc(sizeof(VMM_Span));
+   if (!span)
+   {
+      printf("[vmm] arena free: out of memory, leaking 0x%08x+0x%x\n", addr,
+             size);
+      arena->free_bytes -= size;
+      return;
+   }
+   span->start = addr;
+   span->size = size;
+   span->next = next;
+   if (prev)
+      prev->next = span;
+   else
+      arena->free_list = span;
+}
+
 void VMM_Initialize(void)
 {
    // Get the kernel page directory from paging subsystem
@@ -31,12 +162,14 @@ void VMM_Initialize(void)
       // Skip further VMM work to avoid faults
       return;
    }
+   VMM_ArenaInitialize(&kernel_arena, VMM_KERNEL_ARENA_BASE,
+                       KERNEL_BASE - VMM_KERNEL_ARENA_BASE);
    printf("[vmm] initialized with kernel page dir at 0x%08x\n",
           (uint32_t)kernel_page_dir);
 }
 
-void *VMM_AllocateInDir(void *page_dir, uint32_t *next_vaddr_state,
-                        uint32_t size, uint32_t flags)
+void *VMM_AllocateInDir(void *page_dir, VMM_Arena *arena, uint32_t size,
+                        uint32_t align, uint32_t flags)
 {
    if (size == 0) return NULL;
 
@@ -44,24 +177,21 @@ void *VMM_AllocateInDir(void *page_dir, uint32_t *next_vaddr_state,
    uint32_t aligned_size = PAGE_ALIGN_UP(size);
    uint32_t num_pages = aligned_size / PAGE_SIZE;
 
-   // Choose bump pointer: per-dir state or kernel default
-   uint32_t *bump = next_vaddr_state ? next_vaddr_state : &kernel_next_vaddr;
-
-   // Find a free virtual address range (simple bump allocator)
-   if (*bump + aligned_size > KERNEL_BASE || *bump + aligned_size < *bump)
+   // Reserve the range plus an unmapped guard gap behind it
+   if (!arena) arena = &kernel_arena;
+   uint32_t vaddr =
+       VMM_ArenaAllocate(arena, aligned_size + VMM_GUARD_SIZE, align);
+   if (vaddr == 0)
    {
       printf("[vmm] VMM_Allocate: virtual address space exhausted\n");
       return NULL;
    }
 
-   uint32_t vaddr = *bump;
-   *bump += aligned_size;
-
    // Allocate and map physical pages
    uint32_t mapped_pages = 0;
    for (uint32_t i = 0; i < num_pages; ++i)
    {
-      uint32_t paddr = PMM_AllocatePhysicalPage();
+      uint32_t paddr = PMM_AllocateZeroedPage();
       if (paddr == 0)
       {
          printf("[vmm] VMM_Allocate: failed to allocate physical page %u/%u\n",
@@ -76,12 +206,6 @@ void *VMM_AllocateInDir(void *page_dir, uint32_t *next_vaddr_state,
          PMM_FreePhysicalPage(paddr);
          goto fail_cleanup;
       }
-
-      // Zero-fill only if we're in the same active address space
-      if (HAL_Paging_GetCurrentPageDirectory() == page_dir)
-      {
-         memset((void *)va, 0, PAGE_SIZE);
-      }
       mapped_pages++;
    }
 
@@ -96,15 +220,24 @@ fail_cleanup:
       HAL_Paging_UnmapPage(page_dir, va_cleanup);
       if (pa_cleanup) PMM_FreePhysicalPage(pa_cleanup);
    }
+   VMM_ArenaFree(arena, vaddr, aligned_size + VMM_GUARD_SIZE);
    return NULL;
 }
 
 void *VMM_Allocate(uint32_t size, uint32_t flags)
 {
-   return VMM_AllocateInDir(kernel_page_dir, &kernel_next_vaddr, size, flags);
+   return VMM_AllocateInDir(kernel_page_dir, &kernel_arena, size, PAGE_SIZE,
+                            flags);
+}
+
+void *VMM_AllocateAligned(uint32_t size, uint32_t align, uint32_t flags)
+{
+   return VMM_AllocateInDir(kernel_page_dir, &kernel_arena, size, align,
+                            flags);
 }
 
-void VMM_FreeInDir(void *page_dir, void *vaddr, uint32_t size)
+void VMM_FreeInDir(void *page_dir, VMM_Arena *arena, void *vaddr,
+                   uint32_t size)
 {
    if (!vaddr || size == 0) return;
 
@@ -124,11 +257,15 @@ void VMM_FreeInDir(void *page_dir, void *vaddr, uint32_t size)
          PMM_FreePhysicalPage(page_pa);
       }
    }
+
+   // Return the range and its guard gap
+   VMM_ArenaFree(arena ? arena : &kernel_arena, va,
+                 aligned_size + VMM_GUARD_SIZE);
 }
 
 void VMM_Free(void *vaddr, uint32_t size)
 {
-   VMM_FreeInDir(kernel_page_dir, vaddr, size);
+   VMM_FreeInDir(kernel_page_dir, &kernel_arena, vaddr, size);
 }
 
 bool VMM_MapInDir(void *page_dir, uint32_t vaddr, uint32_t paddr, uint32_t size,
@@ -202,6 +339,22 @@ uint32_t VMM_GetPhys(uint32_t vaddr)
 
 void *VMM_GetPageDirectory(void) { return kernel_page_dir; }
 
+bool VMM_HandlePageFault(uint32_t fault_addr, uint32_t error_code)
+{
+   void *page_dir = HAL_Paging_GetCurrentPageDirectory();
+
+   // Write to a present page: copy-on-write break
+   if ((error_code & 0x3) == 0x3)
+      return HAL_Paging_HandleCowFault(page_dir, fault_addr);
+   if (error_code & 0x1) return false;
+
+   // Not present: demand-paged heap of the running process
+   Process *proc = Process_GetCurrent();
+   if (!proc || proc->page_directory != page_dir) return false;
+
+   return Heap_ProcessHandleFault(proc, fault_addr);
+}
+
 void vmm_self_test(void)
 {
    printf("[vmm] self-test: starting\n");
@@ -252,5 +405,38 @@ void vmm_self_test(void)
       return;
    }
 
-   printf("[vmm] self-test: PASS (alloc/map/write/read/free)\n");
+   // Freed ranges are reused, aligned requests honour the alignment and
+   // neighbouring allocations are separated by a guard gap
+   void *v3 = VMM_Allocate(PAGE_SIZE, VMM_DEFAULT);
+   if (v3 != v1)
+   {
+      printf("[vmm] self-test: FAIL (freed range not reused)\n");
+      return;
+   }
+
+   void *v4 = VMM_AllocateAligned(PAGE_SIZE, 0x10000u, VMM_DEFAULT);
+   if (!v4 || ((uint32_t)v4 & 0xFFFFu) != 0)
+   {
+      printf("[vmm] self-test: FAIL (aligned allocation)\n");
+      return;
+   }
+
+   if ((uint32_t)v2 < (uint32_t)v3 + PAGE_SIZE + VMM_GUARD_SIZE)
+   {
+      printf("[vmm] self-test: FAIL (missing guard gap)\n");
+      return;
+   }
+
+   uint32_t free_before = kernel_arena.free_bytes;
+   VMM_Free(v2, PAGE_SIZE * 2);
+   VMM_Free(v3, PAGE_SIZE);
+   VMM_Free(v4, PAGE_SIZE);
+   if (kernel_arena.free_bytes != KERNEL_BASE - VMM_KERNEL_ARENA_BASE ||
+       kernel_arena.free_bytes <= free_before)
+   {
+      printf("[vmm] self-test: FAIL (arena did not coalesce)\n");
+      return;
+   }
+
+   printf("[vmm] self-test: PASS (alloc/map/write/read/free/reuse)\n");
 }
@@ -18,17 +18,45 @@
  */
 void VMM_Initialize(void);
 
+/* Virtual address arena: a sorted, coalescing free list of page-aligned
+ * spans. The kernel arena covers [2 GiB, 3 GiB); callers may set up their
+ * own (e.g. per address space).
+ */
+typedef struct VMM_Span VMM_Span;
+typedef struct
+{
+   uint32_t base;
+   uint32_t size;
+   VMM_Span *free_list;
+   uint32_t free_bytes;
+} VMM_Arena;
+
+/* Unmapped gap reserved behind every VMM allocation so overruns fault */
+#define VMM_GUARD_SIZE 0x1000u
+
+void VMM_ArenaInitialize(VMM_Arena *arena, uint32_t base, uint32_t size);
+
+/* Reserve size bytes (page-rounded) aligned to align (a power of two, at
+ * least a page). Returns 0 if no span is large enough.
+ */
+uint32_t VMM_ArenaAllocate(VMM_Arena *arena, uint32_t size, uint32_t align);
+void VMM_ArenaFree(VMM_Arena *arena, uint32_t addr, uint32_t size);
+
 /* Allocate and map virtual memory in a page directory.
- * If next_vaddr_state is NULL, uses the kernel allocator bump pointer.
+ * If arena is NULL, the range comes from the kernel arena.
  */
-void *VMM_AllocateInDir(void *page_dir, uint32_t *next_vaddr_state,
-                        uint32_t size, uint32_t flags);
+void *VMM_AllocateInDir(void *page_dir, VMM_Arena *arena, uint32_t size,
+                        uint32_t align, uint32_t flags);
 
-/* Kernel convenience wrapper */
+/* Kernel convenience wrappers */
 void *VMM_Allocate(uint32_t size, uint32_t flags);
+void *VMM_AllocateAligned(uint32_t size, uint32_t align, uint32_t flags);
 
-/* Free previously allocated virtual memory */
-void VMM_FreeInDir(void *page_dir, void *vaddr, uint32_t size);
+/* Unmap, free and return previously allocated virtual memory; size and
+ * arena must match the allocation.
+ */
+void VMM_FreeInDir(void *page_dir, VMM_Arena *arena, void *vaddr,
+                   uint32_t size);
 void VMM_Free(void *vaddr, uint32_t size);
 
 /* Map existing physical memory */
@@ -47,6 +75,13 @@ uint32_t VMM_GetPhys(uint32_t vaddr);
 /* Get current process page directory (for context switch) */
 void *VMM_GetPageDirectory(void);
 
+/* Resolve a page fault in the active address space (copy-on-write break or
+ * demand-paged heap).
+ * error_code is the CPU page-fault error code.
+ * Returns true if the faulting access can be retried.
+ */
+bool VMM_HandlePageFault(uint32_t fault_addr, uint32_t error_code);
+
 /* Flags for mapping (use with PAGE_* from paging.h)
  */
 #define VMM_RW 0x002         // Read/Write
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#include "trace.h"
+
+uint8_t g_TraceLevels[TRACE_SUBSYSTEM_COUNT] = {
+    [TRACE_FAT] = TRACE_DEFAULT_LEVEL,
+    [TRACE_FD] = TRACE_DEFAULT_LEVEL,
+    [TRACE_SYSCALL] = TRACE_DEFAULT_LEVEL,
+};
+
+int Trace_SetLevel(Trace_Subsystem subsystem, int level)
+{
+   if (subsystem >= TRACE_SUBSYSTEM_COUNT) return TRACE_LEVEL_OFF;
+   if (level < TRACE_LEVEL_OFF) level = TRACE_LEVEL_OFF;
+   if (level > TRACE_LEVEL_DEBUG) level = TRACE_LEVEL_DEBUG;
+
+   int previous = g_TraceLevels[subsystem];
+   g_TraceLevels[subsystem] = (uint8_t)level;
+   return previous;
+}
+
+int Trace_GetLevel(Trace_Subsystem subsystem)
+{
+   if (subsystem >= TRACE_SUBSYSTEM_COUNT) return TRACE_LEVEL_OFF;
+   return g_TraceLevels[subsystem];
+}
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+#pragma once
+#include <std/stdio.h>
+#include <stdint.h>
+
+// Per-subsystem tracing. A message is printed when its level is within both
+// the subsystem's compile-time ceiling and its run-time level, so messages
+// above the ceiling cost nothing: not even their arguments are evaluated.
+//
+//    TRACE_DEBUG(FAT, "FAT_Write: %u bytes\n", count);
+
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_ERROR 1 // Failed operations
+#define TRACE_LEVEL_INFO 2  // Mounts and occasional operations
+#define TRACE_LEVEL_DEBUG 3 // Per call, per entry and per sector detail
+
+typedef enum
+{
+   TRACE_FAT,
+   TRACE_FD,
+   TRACE_SYSCALL,
+   TRACE_SUBSYSTEM_COUNT
+} Trace_Subsystem;
+
+// Compile-time ceiling, override per subsystem with e.g. -DTRACE_MAX_FAT=3.
+// Release builds keep only errors.
+#ifndef TRACE_MAX_LEVEL
+#ifdef RELEASE
+#define TRACE_MAX_LEVEL TRACE_LEVEL_ERROR
+#else
+#define TRACE_MAX_LEVEL TRACE_LEVEL_DEBUG
+#endif
+#endif
+
+#ifndef TRACE_MAX_FAT
+#define TRACE_MAX_FAT TRACE_MAX_LEVEL
+#endif
+#ifndef TRACE_MAX_FD
+#define TRACE_MAX_FD TRACE_MAX_LEVEL
+#endif
+#ifndef TRACE_MAX_SYSCALL
+#define TRACE_MAX_SYSCALL TRACE_MAX_LEVEL
+#endif
+
+// Run-time level every subsystem starts at
+#ifndef TRACE_DEFAULT_LEVEL
+#define TRACE_DEFAULT_LEVEL TRACE_LEVEL_INFO
+#endif
+
+extern uint8_t g_TraceLevels[TRACE_SUBSYSTEM_COUNT];
+
+// Set the run-time level of a subsystem, returns the previous one. Levels
+// above the compile-time ceiling have no effect.
+int Trace_SetLevel(Trace_Subsystem subsystem, int level);
+int Trace_GetLevel(Trace_Subsystem subsystem);
+
+#define TRACE_ENABLED(sub, level)                                              \
+   ((level) <= TRACE_MAX_##sub && (level) <= g_TraceLevels[TRACE_##sub])
+
+#define TRACE(sub, level, ...)                                                 \
+   do                                                                          \
+   {                                                                           \
+      if (TRACE_ENABLED(sub, level)) printf(__VA_ARGS__);                      \
+   } while (0)
+
+#define TRACE_ERROR(sub, ...) TRACE(sub, TRACE_LEVEL_ERROR, __VA_ARGS__)
+#define TRACE_INFO(sub, ...) TRACE(sub, TRACE_LEVEL_INFO, __VA_ARGS__)
+#define TRACE_DEBUG(sub, ...) TRACE(sub, TRACE_LEVEL_DEBUG, __VA_ARGS__)
@@ -214,10 +214,10 @@ Process *ELF_LoadProcess(Partition *disk, const char *filename,
       for (uint32_t j = 0; j < pages_needed; ++j)
       {
          uint32_t page_va = vaddr + (j * 4096);
-         uint32_t phys = PMM_AllocatePhysicalPage();
+         uint32_t phys = PMM_AllocateZeroedPage();
          if (phys == 0)
          {
-            printf("[ELF] LoadProcess: PMM_AllocatePhysicalPage failed\n");
+            printf("[ELF] LoadProcess: PMM_AllocateZeroedPage failed\n");
             Process_Destroy(proc);
             FAT_Close(file);
             return NULL;
@@ -274,11 +274,7 @@ Process *ELF_LoadProcess(Partition *disk, const char *filename,
          remaining -= bytes_read;
       }
 
-      // Zero out BSS (memsz > filesz)
-      if (memsz > filesz)
-      {
-         memset((void *)(vaddr + filesz), 0, memsz - filesz);
-      }
+      // BSS (memsz > filesz) needs no clearing: segment pages come zeroed
 
       // Restore kernel page directory
       HAL_Paging_SwitchPageDirectory(old_pdir);
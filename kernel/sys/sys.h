@@ -14,6 +14,7 @@ extern __attribute__((cdecl)) void get_cpu_brand(char *brand);
 extern __attribute__((cdecl)) uint32_t get_cpu_frequency(void);
 extern __attribute__((cdecl)) uint32_t get_cache_line_size(void);
 extern __attribute__((cdecl)) uint32_t get_cpu_features(void);
+extern __attribute__((cdecl)) uint32_t get_cpu_ext_features(void);
 
 /* Multiboot structures for memory detection */
 typedef struct
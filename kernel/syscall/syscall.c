@@ -5,6 +5,7 @@
 #include <fs/fd.h>
 #include <mem/heap.h>
 #include <std/stdio.h>
+#include <std/trace.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -72,6 +73,14 @@ intptr_t sys_lseek(int fd, int32_t offset, int whence)
    return FD_Lseek(proc, fd, offset, whence);
 }
 
+intptr_t sys_fallocate(int fd, int mode, uint32_t offset, uint32_t length)
+{
+   Process *proc = Process_GetCurrent();
+   if (!proc) return -1;
+
+   return FD_Allocate(proc, fd, mode, offset, length);
+}
+
 /* Generic syscall dispatcher
  *
  * Called by arch-specific handler after extracting parameters from registers.
@@ -102,8 +111,13 @@ intptr_t syscall(uint32_t syscall_num, uint32_t *args)
    case SYS_LSEEK:
       return sys_lseek(args[0], (int32_t)args[1], args[2]);
 
+   case SYS_FALLOCATE:
+      // Linux i386 layout: offset and length are 64-bit register pairs
+      if (args[3] != 0 || args[5] != 0) return -1;
+      return sys_fallocate(args[0], args[1], args[2], args[4]);
+
    default:
-      printf("[syscall] unknown syscall %u\n", syscall_num);
+      TRACE_ERROR(SYSCALL, "[syscall] unknown syscall %u\n", syscall_num);
       return -1;
    }
 }
@@ -13,6 +13,7 @@
 #define SYS_READ 3
 #define SYS_WRITE 4
 #define SYS_LSEEK 19
+#define SYS_FALLOCATE 324
 
 /* Syscall handler prototypes
  * These are called by arch-specific dispatcher after extracting parameters
@@ -24,6 +25,7 @@ intptr_t sys_close(int fd);
 intptr_t sys_read(int fd, void *buf, uint32_t count);
 intptr_t sys_write(int fd, const void *buf, uint32_t count);
 intptr_t sys_lseek(int fd, int32_t offset, int whence);
+intptr_t sys_fallocate(int fd, int mode, uint32_t offset, uint32_t length);
 
 /* Generic syscall dispatcher (arch code calls this)
  * syscall_num: syscall number